@@ -0,0 +1,101 @@
+#include <benchmark/benchmark.h>
+#include "utils_ann.h"
+#include "bench_utils.h"
+
+// Distance of two points for every datatype and some common dimensions
+template <typename datatype>
+static void BM_CalculateDistance(benchmark::State& state){
+    std::size_t dim = state.range(0);
+    auto points = randomPoints<datatype>(2, dim);
+
+    for(auto _ : state){
+        benchmark::DoNotOptimize(calculateDistance(points[0], points[1], dim));
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * 2 * dim * sizeof(datatype));
+}
+BENCHMARK_TEMPLATE(BM_CalculateDistance, float)->Arg(16)->Arg(100)->Arg(128)->Arg(960);
+BENCHMARK_TEMPLATE(BM_CalculateDistance, int)->Arg(16)->Arg(100)->Arg(128)->Arg(960);
+BENCHMARK_TEMPLATE(BM_CalculateDistance, unsigned char)->Arg(16)->Arg(100)->Arg(128)->Arg(960);
+
+// Distances of a point to the neighbours of a node, one by one or in batches with prefetching
+static void BM_NeighbourDistances(benchmark::State& state){
+    bool batched = state.range(0);
+    std::size_t n = 100000, neighbours = 64;
+    auto points = randomPoints<float>(n, 100);
+    auto query = randomPoints<float>(1, 100, 1)[0];
+
+    std::mt19937 gen(0);
+    std::vector<int> nodes(neighbours);
+    for(auto _ : state){
+        state.PauseTiming();
+        for(auto& node : nodes){
+            node = gen() % n;
+        }
+        CompareVectors<float> compare(points, query);
+        state.ResumeTiming();
+
+        if(batched){
+            compare.computeDistances(nodes);
+        }
+        else{
+            for(std::size_t i = 0; i + 1 < neighbours; i++){
+                benchmark::DoNotOptimize(compare(nodes[i], nodes[i + 1]));
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * neighbours);
+}
+BENCHMARK(BM_NeighbourDistances)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+// Comparisons of a new comparator, where every distance is calculated once and then read from the cache
+static void BM_CompareVectorsFirst(benchmark::State& state){
+    std::size_t n = state.range(0);
+    auto points = randomPoints<float>(n, 100);
+    auto query = randomPoints<float>(1, 100, 1)[0];
+
+    for(auto _ : state){
+        CompareVectors<float> compare(points, query);
+        for(std::size_t i = 0; i + 1 < n; i++){
+            benchmark::DoNotOptimize(compare(i, i + 1));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * (n - 1));
+}
+BENCHMARK(BM_CompareVectorsFirst)->Arg(1000)->Arg(10000);
+
+// Comparisons of a comparator that has all the distances cached
+static void BM_CompareVectorsCached(benchmark::State& state){
+    std::size_t n = state.range(0);
+    auto points = randomPoints<float>(n, 100);
+    auto query = randomPoints<float>(1, 100, 1)[0];
+    CompareVectors<float> compare(points, query, true);
+
+    for(auto _ : state){
+        for(std::size_t i = 0; i + 1 < n; i++){
+            benchmark::DoNotOptimize(compare(i, i + 1));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * (n - 1));
+}
+BENCHMARK(BM_CompareVectorsCached)->Arg(1000)->Arg(10000);
+
+// Distances of a batch of points in cache, for fixed dimensions and the dimensions right after them, which run
+// the loops with the dimension read at runtime
+static void BM_FixedDimensionDistances(benchmark::State& state){
+    std::size_t dim = state.range(0), n = 64;
+    auto points = randomPoints<float>(n, dim);
+    auto query = randomPoints<float>(1, dim, 1)[0];
+    std::vector<const std::vector<float>*> pointers;
+    for(const auto& point : points){
+        pointers.push_back(&point);
+    }
+    std::vector<float> distances(n);
+
+    for(auto _ : state){
+        calculateDistances(query, pointers.data(), n, dim, distances.data());
+        benchmark::DoNotOptimize(distances.data());
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_FixedDimensionDistances)->Arg(100)->Arg(101)->Arg(128)->Arg(129)->Arg(960)->Arg(961);
@@ -0,0 +1,39 @@
+#include <benchmark/benchmark.h>
+#include "graph.h"
+
+// Add R edges to every node of an empty graph
+static void BM_GraphAddEdge(benchmark::State& state){
+    std::size_t n = 10000;
+    int R = state.range(0);
+
+    for(auto _ : state){
+        Graph graph(n, true);
+        for(std::size_t i = 0; i < n; i++){
+            for(int j = 1; j <= R; j++){
+                graph.addEdge(i, (i + j * 37) % n);
+            }
+        }
+        benchmark::DoNotOptimize(graph.countNeighbours(0));
+    }
+    state.SetItemsProcessed(state.iterations() * n * R);
+}
+BENCHMARK(BM_GraphAddEdge)->Arg(16)->Arg(64)->Unit(benchmark::kMillisecond);
+
+// Walk the neighbours of every node of an R-regular graph
+static void BM_GraphGetNeighbours(benchmark::State& state){
+    std::size_t n = 10000;
+    int R = state.range(0);
+    Graph graph(n, (size_t)R);
+
+    for(auto _ : state){
+        long sum = 0;
+        for(std::size_t i = 0; i < n; i++){
+            for(int neighbour : graph.getNeighbours(i)){
+                sum += neighbour;
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * n * R);
+}
+BENCHMARK(BM_GraphGetNeighbours)->Arg(16)->Arg(64)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,65 @@
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <fstream>
+#include "parse.h"
+#include "bench_utils.h"
+
+#define BENCH_PARSE_POINTS 20000
+
+// fvecs file of random points, written once
+static const std::string& fvecsFile(){
+    static std::string path = [](){
+        std::string file = "./build/bench_points.fvecs";
+        std::ofstream out(file, std::ios::binary);
+        int dim = 128;
+        for(const auto& point : randomPoints<float>(BENCH_PARSE_POINTS, dim)){
+            out.write((char*)&dim, sizeof(int));
+            out.write((char*)point.data(), dim * sizeof(float));
+        }
+        return file;
+    }();
+    return path;
+}
+
+// bin file of random points with a filter and a timestamp, written once
+static const std::string& binFile(){
+    static std::string path = [](){
+        std::string file = "./build/bench_points.bin";
+        std::ofstream out(file, std::ios::binary);
+        uint32_t n = BENCH_PARSE_POINTS;
+        out.write((char*)&n, sizeof(uint32_t));
+        auto points = randomPoints<float>(n, 100);
+        for(uint32_t i = 0; i < n; i++){
+            float filter = (float)(i % 10);
+            float timestamp = (float)i / n;
+            out.write((char*)&filter, sizeof(float));
+            out.write((char*)&timestamp, sizeof(float));
+            out.write((char*)points[i].data(), 100 * sizeof(float));
+        }
+        return file;
+    }();
+    return path;
+}
+
+static void BM_ParseVecs(benchmark::State& state){
+    const std::string& path = fvecsFile();
+    for(auto _ : state){
+        auto points = parseVecs<float>(path);
+        benchmark::DoNotOptimize(points.data());
+    }
+    state.SetItemsProcessed(state.iterations() * BENCH_PARSE_POINTS);
+}
+BENCHMARK(BM_ParseVecs)->Unit(benchmark::kMillisecond);
+
+static void BM_ParseDataVector(benchmark::State& state){
+    const std::string& path = binFile();
+    for(auto _ : state){
+        std::vector<float> filters;
+        std::vector<float> timestamps;
+        std::vector<std::vector<float>> points;
+        parseDataVector(path, filters, timestamps, points);
+        benchmark::DoNotOptimize(points.data());
+    }
+    state.SetItemsProcessed(state.iterations() * BENCH_PARSE_POINTS);
+}
+BENCHMARK(BM_ParseDataVector)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,106 @@
+#include <benchmark/benchmark.h>
+#include "ann.h"
+#include "bench_utils.h"
+
+#define BENCH_POINTS 10000
+#define BENCH_DIM 100
+#define BENCH_R 32
+#define BENCH_QUERIES 64
+
+// The graph is built once and shared by every benchmark of this file
+static ANN<float>& benchIndex(){
+    static ANN<float>* ann = [](){
+        ANN<float>* index = new ANN<float>(randomPoints<float>(BENCH_POINTS, BENCH_DIM), (size_t)BENCH_R);
+        index->Vamana(1.2, 100, BENCH_R);
+        return index;
+    }();
+    return *ann;
+}
+
+// Greedy search from the medoid at different L, one query per iteration
+static void BM_GreedySearch(benchmark::State& state){
+    ANN<float>& ann = benchIndex();
+    int L = state.range(0);
+    int start = ann.getMedoid();
+    auto queries = randomPoints<float>(BENCH_QUERIES, BENCH_DIM, 1);
+
+    std::size_t q = 0;
+    for(auto _ : state){
+        CompareVectors<float> compare(ann.node_to_point_map, queries[q++ % BENCH_QUERIES]);
+        std::set<int, CompareVectors<float>> NNS(compare);
+        std::unordered_set<int> Visited;
+        NNS.insert(start);
+
+        ann.greedySearch(start, 10, L, NNS, Visited, compare);
+        benchmark::DoNotOptimize(NNS.begin());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GreedySearch)->Arg(50)->Arg(100)->Arg(200)->Unit(benchmark::kMicrosecond);
+
+// Batches of queries advanced together by batchGreedySearch at L = 100, an item is a query
+static void BM_BatchGreedySearch(benchmark::State& state){
+    ANN<float>& ann = benchIndex();
+    std::size_t batch = state.range(0);
+    int start = ann.getMedoid();
+    auto queries = randomPoints<float>(BENCH_QUERIES, BENCH_DIM, 1);
+
+    std::size_t q = 0;
+    for(auto _ : state){
+        std::vector<CompareVectors<float>> compares;
+        std::vector<std::set<int, CompareVectors<float>>> NNS;
+        compares.reserve(batch);
+        NNS.reserve(batch);
+        for(std::size_t i = 0; i < batch; i++){
+            compares.emplace_back(ann.node_to_point_map, queries[q++ % BENCH_QUERIES]);
+            NNS.emplace_back(compares.back());
+        }
+        std::vector<std::unordered_set<int>> Visited(batch);
+
+        ann.batchGreedySearch(start, 10, 100, NNS, Visited, compares);
+        benchmark::DoNotOptimize(NNS.data());
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(BM_BatchGreedySearch)->Arg(1)->Arg(4)->Arg(8)->Arg(16)->Unit(benchmark::kMicrosecond);
+
+// Copy of the shared index with the same points and edges, for the benchmarks that change the graph
+static ANN<float>& benchIndexCopy(){
+    static ANN<float>* ann = [](){
+        ANN<float>& shared = benchIndex();
+        std::vector<std::unordered_set<int>> edges(BENCH_POINTS);
+        std::vector<int> neighbours;
+        for(int i = 0; i < BENCH_POINTS; i++){
+            neighbours.clear();
+            shared.neighbourNodes(i, neighbours);
+            edges[i].insert(neighbours.begin(), neighbours.end());
+        }
+        return new ANN<float>(shared.node_to_point_map, edges);
+    }();
+    return *ann;
+}
+
+// Robust prune of a node with the closest candidates of a set of the given size. The prune replaces the edges
+// of the node, so it runs on a copy and the searches still use the graph of Vamana.
+static void BM_RobustPrune(benchmark::State& state){
+    ANN<float>& ann = benchIndexCopy();
+    std::size_t size = state.range(0);
+
+    int point = 0;
+    for(auto _ : state){
+        state.PauseTiming();
+        point = (point + 1) % BENCH_POINTS;
+        CompareVectors<float> compare(ann.node_to_point_map, ann.node_to_point_map[point]);
+        std::set<int, CompareVectors<float>> candidates(compare);
+        for(std::size_t i = 0; candidates.size() < size; i++){
+            int candidate = (int)((point + 1 + i * 7919) % BENCH_POINTS);
+            if(candidate != point)
+                candidates.insert(candidate);
+        }
+        state.ResumeTiming();
+
+        ann.robustPrune(point, candidates, 1.2, BENCH_R, UNFILTERED);
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_RobustPrune)->Arg(64)->Arg(256)->Arg(1024)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,22 @@
+#ifndef BENCH_UTILS_H
+#define BENCH_UTILS_H
+
+#include <random>
+#include <vector>
+
+// Random points with coordinates in [0, 100), the same for the same seed
+template <typename datatype>
+std::vector<std::vector<datatype>> randomPoints(std::size_t n, std::size_t dim, unsigned seed = 0){
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> dis(0.0f, 100.0f);
+
+    std::vector<std::vector<datatype>> points(n, std::vector<datatype>(dim));
+    for(auto& point : points){
+        for(auto& coordinate : point){
+            coordinate = (datatype)dis(gen);
+        }
+    }
+    return points;
+}
+
+#endif // bench_utils.h
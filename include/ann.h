@@ -5,8 +5,26 @@
 #define FILTERED true
 #define UNFILTERED false
 
+#define MATCH_ALL true
+#define MATCH_ANY false
+
+#define UNKNOWN_LABEL UINT32_MAX
+
+#define NN_DESCENT_ITERATIONS 10
+#define NN_DESCENT_DELTA 0.001f
+
+#define BATCH_LABEL_SIZE 10000          // Filters with more points are inserted in parallel batches
+#define MAX_BATCH_FRACTION 0.02         // Largest batch as a part of the points of the filter
+
+#define FIND_MEDOID_THRESHOLD 100
+#define START_POINTS_PER_LABEL 3
+
+#define ID_MAP_TAG 0x50414d44495f4e41ULL  // Marks the original ids after the adjacency of a saved reordered graph
+#define MEDOID_TAG 0x494f44454d5f4e41ULL  // Marks the start node of the build after the adjacency of a saved graph
+
 #include <iostream>
 #include <vector>
+#include <cstdint>
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
@@ -15,66 +33,183 @@
 #include <iterator> 
 #include "graph.h"
 #include "utils_ann.h"
+#include "config.h"
+#include "memory_usage.h"
+#include "scratch.h"
 #include <random>
 #include <optional>
 #include <chrono>
+#include <mutex>
+#include <numeric>
 
-template <class datatype>
+// A pass of the Vamana algorithm over all the points with its own alpha and L
+struct VamanaPass{
+    float alpha;
+    int L;
+};
+
+// Label ids of a query and if a point needs all of them or any of them
+struct LabelPredicate{
+    std::vector<uint32_t> labels;                           // Sorted label ids
+    uint64_t signature;                                     // Bit (label % 64) is set for every label
+    bool match_all;
+};
+
+// Metric is a policy of utils_ann.h, e.g. ANN<float, CosineMetric>. Cosine normalizes the points when they are inserted.
+template <class datatype, class Metric = L2Metric>
 class ANN{
 private:
     Graph* G;
-    std::unordered_map<std::vector<datatype>, int, VectorHash<datatype>> point_to_node_map;
-    std::unordered_map<float, std::vector<int>> filter_to_node_map;
-    std::unordered_map<float, int> filter_to_start_node;
     std::optional<int> cached_medoid;
 
-    template <typename Compare>
-    void pruneSet(std::set<int, Compare>&,std::set<int, Compare> &, int k);
+    // Filter values are mapped to dense label ids when the points are inserted.
+    // The hash map is used only to translate the filter values of queries.
+    std::unordered_map<float, uint32_t> label_ids;
+    std::vector<float> label_values;                        // Filter value of every label
+    std::vector<int> label_offsets;                         // Nodes of label l are label_nodes[label_offsets[l]..label_offsets[l+1])
+    std::vector<int> label_nodes;
+    std::vector<int> label_start_node;                      // Start node of every label, -1 if there is none
+    std::vector<int> label_start_offsets;                   // Start points of label l are label_starts[label_start_offsets[l]..label_start_offsets[l+1])
+    std::vector<int> label_starts;
+
+    // Sorted label ids of node i are node_label_ids[node_label_offsets[i]..node_label_offsets[i+1]).
+    // The signature has bit (label % 64) set for every label of the node, so most checks end without the list.
+    std::vector<int> node_label_offsets;
+    std::vector<uint32_t> node_label_ids;
+    std::vector<uint64_t> node_label_signature;
+    bool shared_labels = false;                             // True if some node has more than one label
+    std::size_t build_scratch_bytes = 0;                    // Largest scratch arena of a build thread, 0 if nothing was built
+
+    // All the nodes sorted by timestamp. The nodes of every label are sorted by timestamp too.
+    std::vector<int> timestamp_order;
+
+    template <typename Compare, typename Allocator>
+    void pruneSet(std::set<int, Compare, Allocator>&,std::set<int, Compare, Allocator> &, int k);
 
     bool checkErrorsGreedy(const int &start, int k, int upper_limit);
     bool checkErrorsRobust(const int &point, const float alpha, const int degree_bound);
     void calculateMedoid();
     void randomMedoid();
+    void findMedoid();
     void filteredPruning();
+    void initLabels(const std::vector<float>& filters);
+    void initLabels(const std::vector<float>& filters, const std::vector<int>& offsets);
+    bool hasLabel(int node, uint32_t label);
+    bool shareLabel(int a, int b);
+    bool labelsCovered(int point, int element, int closest);
+    bool matchesPredicate(int node, const LabelPredicate& predicate);
+    LabelPredicate makePredicate(const std::vector<float>& filters, bool match_all);
+    void sharedLabelVamana(const std::vector<VamanaPass>& passes, int R);
+    template <typename Compare, typename Allocator>
+    void selectNeighbours(const int& point, std::set<int, Compare, Allocator>& candidate_set, const float alpha, const int degree_bound, bool filtered, std::vector<int>& selected);
+    template <typename Select, typename Reprune>
+    void batchInsert(const std::vector<int>& points, int R, Select select, Reprune reprune);
+    template <typename Compare>
+    void pruneBridges(int point, std::set<int, Compare>& candidate_set, float alpha, int B);
+    template <typename Compare, typename Navigate, typename Accept>
+    void subgraphSearch(const std::vector<int>& seeds, int k, int upper_limit, int search_limit, Navigate navigate, Accept accept, std::set<int, Compare>& NNS, std::unordered_set<int>& Visited, CompareVectors<datatype, Metric>& compare);
+    uint32_t labelId(float filter);
+    std::vector<int> labelNodes(uint32_t label);
+    void initTimestamps(const std::vector<float>& timestamps);
+    std::pair<const int*, const int*> rangeNodes(uint32_t label, float low, float high);
+    template <typename Compare, typename Allocator>
+    void labelGreedySearch(const int & start_node, int k, int upper_limit, uint32_t label, std::set<int, Compare, Allocator>& NNS, VisitedSet<Allocator>& Visited, CompareVectors<datatype, Metric>& compare, SearchStats* stats = nullptr);
+    void nnDescent(const std::vector<int>& nodes, int K, int iterations, float delta);
+    int subsetMedoid(const std::vector<int>& nodes);
+    void subsetVamana(const std::vector<int>& nodes, const std::vector<int>& local_index, const std::vector<VamanaPass>& passes, int R, bool nn_descent);
+    void releaseScratch();
+    void applyOrder(const std::vector<int>& order, bool permute_graph);
+    void normalizePoints();
 public:
     std::vector<std::vector<datatype>> node_to_point_map;
-    std::vector<float> node_to_filter_map;                  // Filter values for each node
+    std::vector<uint32_t> node_to_label;                    // Label id for each node, the smallest one if it has several
+    std::vector<float> node_to_timestamp;                   // Timestamp for each node
+    std::vector<int> node_to_original;                      // Id of each node in the input, empty if the nodes were not reordered
+    RuntimeConfig config;                                   // Threads and strategies of the build, set before it starts
 
+    // Every constructor copies the points, or takes them without a copy if they are moved in
     ANN(const std::vector<std::vector<datatype>>& points);
+    ANN(std::vector<std::vector<datatype>>&& points);
     ANN(const std::vector<std::vector<datatype>>& points, const std::vector<std::unordered_set<int>>& edges);
+    ANN(std::vector<std::vector<datatype>>&& points, const std::vector<std::unordered_set<int>>& edges);
     ANN(const std::vector<std::vector<datatype>>& points, size_t reg);
+    ANN(std::vector<std::vector<datatype>>&& points, size_t reg);
     ANN(const std::vector<std::vector<datatype>>& points, const std::vector<float>& filters);
+    ANN(std::vector<std::vector<datatype>>&& points, const std::vector<float>& filters);
     ANN(const std::vector<std::vector<datatype>>& points, const std::vector<std::unordered_set<int>>& edges, const std::vector<float>& filters);
+    ANN(std::vector<std::vector<datatype>>&& points, const std::vector<std::unordered_set<int>>& edges, const std::vector<float>& filters);
+    ANN(const std::vector<std::vector<datatype>>& points, const std::vector<float>& filters, const std::vector<float>& timestamps);
+    ANN(std::vector<std::vector<datatype>>&& points, const std::vector<float>& filters, const std::vector<float>& timestamps);
+    ANN(const std::vector<std::vector<datatype>>& points, const std::vector<std::vector<float>>& filter_sets);
+    ANN(std::vector<std::vector<datatype>>&& points, const std::vector<std::vector<float>>& filter_sets);
+
+    // The graph is owned by the index
+    ANN(const ANN&) = delete;
+    ANN& operator=(const ANN&) = delete;
 
     ~ANN();
     bool checkGraph(std::vector<std::unordered_set<int>> edges);
     bool checkNeighbour(int a, int b);
     const int& getMedoid();
 
+    // Medoid that the build started from, the one saved with a loaded graph, or else a new one of config.medoid
+    const int& startMedoid();
+
     // For testing
     bool checkFilteredFindMedoid(std::size_t num_of_filters);
     int getStartNode(float filter);
-    void filteredFindMedoid();
+    void filteredFindMedoid(int threshold = FIND_MEDOID_THRESHOLD, int start_points = START_POINTS_PER_LABEL);
 
     // Fill filter_to_start_node for testing
     void fillFilterToStartNode(std::unordered_map<float, int>& filter_to_start_node);
 
+    // The searches fill stats if it is given and the code is compiled with SEARCH_STATS. The sets of greedySearch,
+    // filteredGreedySearch and robustPrune can use std::allocator or a ScratchArena (ScratchSet and ScratchVisited),
+    // and the sets that they make for themselves use the allocator of NNS or candidate_set.
+    template <typename Compare, typename Allocator>
+    void greedySearch(const int & start_node, int k, int upper_limit, std::set<int, Compare, Allocator>& NNS, VisitedSet<Allocator>& Visited, CompareVectors<datatype, Metric>& compare, SearchStats* stats = nullptr);
+    // Greedy searches of several queries from the same start node on one thread, with the same result as greedySearch
+    // for each. A search stops after it prefetches the vectors of its next expansion and the thread moves on to the
+    // next search, so the memory of one search is loaded while the others compute. Experimental, it only pays off
+    // when the vectors miss the last level cache.
+    template <typename Compare>
+    void batchGreedySearch(const int & start_node, int k, int upper_limit, std::vector<std::set<int, Compare>>& NNS, std::vector<std::unordered_set<int>>& Visited, std::vector<CompareVectors<datatype, Metric>>& compares);
+    template <typename Compare, typename Allocator>
+    void filteredGreedySearch(const int & start_node, int k, int upper_limit,const float & filter, std::set<int, Compare, Allocator>& NNS, VisitedSet<Allocator>& Visited, CompareVectors<datatype, Metric>& compare, SearchStats* stats = nullptr);
     template <typename Compare>
-    void greedySearch(const int & start_node, int k, int upper_limit, std::set<int, Compare>& NNS, std::unordered_set<int>& Visited, CompareVectors<datatype>& compare);
+    void rangeGreedySearch(const int & start_node, int k, int upper_limit, const float & filter, float low, float high, std::set<int, Compare>& NNS, std::unordered_set<int>& Visited, CompareVectors<datatype, Metric>& compare);
     template <typename Compare>
-    void filteredGreedySearch(const int & start_node, int k, int upper_limit,const float & filter, std::set<int, Compare>& NNS, std::unordered_set<int>& Visited, CompareVectors<datatype>& compare);
+    void labelSetGreedySearch(int k, int upper_limit, const std::vector<float>& filters, bool match_all, std::set<int, Compare>& NNS, std::unordered_set<int>& Visited, CompareVectors<datatype, Metric>& compare);
 
     
-    template <typename Compare>
-    void robustPrune(const int & point, std::set<int, Compare>& candidate_set, const float alpha, const int degree_bound, bool filtered);
+    template <typename Compare, typename Allocator>
+    void robustPrune(const int & point, std::set<int, Compare, Allocator>& candidate_set, const float alpha, const int degree_bound, bool filtered);
     
-    void Vamana(float alpha, int L, int R);
-    void filteredVamana(float alpha, int L, int R, int z = 0);
-    void stitchedVamana(float alpha, int L_small, int R_small, int R_stitched, int z = 0);
+    void Vamana(float alpha, int L, int R, bool nn_descent = false);
+    void filteredVamana(float alpha, int L, int R, int z = 0, bool nn_descent = false);
+    void stitchedVamana(float alpha, int L_small, int R_small, int R_stitched, int z = 0, bool nn_descent = false);
+
+    // Multi-pass versions, e.g. a first pass with alpha = 1 and a second with the given alpha
+    void Vamana(const std::vector<VamanaPass>& passes, int R, bool nn_descent = false);
+    void filteredVamana(const std::vector<VamanaPass>& passes, int R, int z = 0, bool nn_descent = false);
+    void stitchedVamana(const std::vector<VamanaPass>& passes, int R_small, int R_stitched, int z = 0, bool nn_descent = false);
+
+    // Edges between the labels of a filtered graph, so that unfiltered queries can start from getMedoid()
+    void addBridgeEdges(int B, float alpha, int L);
+
+    // Approximate kNN graph used as the starting graph of Vamana instead of random edges
+    void nnDescent(int K, int iterations = NN_DESCENT_ITERATIONS, float delta = NN_DESCENT_DELTA);
+
+    // Give new ids to the nodes in the order of the strategy and move the vectors, edges, labels and timestamps with them
+    void reorder(ReorderStrategy strategy);
 
     void neighbourNodes(const int& point, std::vector<int>& neighbours);
     int countNeighbours(int node);
 
+    // Bytes of the vectors, the adjacency, the labels and the timestamps, and an estimate of
+    // the distance map that every build thread keeps for the insertion of a point
+    MemoryReport memoryUsage();
+
     void saveGraph(const std::string &file_path);
     void loadGraph(const std::string &file_path);
     void printGraph();
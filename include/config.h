@@ -0,0 +1,94 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+// Which parts of the build run in parallel
+enum class ParallelStrategy{
+    Serial,         // Everything on one thread
+    Build,          // Filters, batches, NN-Descent, stitching and ground truth
+    Full            // Build and also the random edges and the exact medoid
+};
+
+// How the start node of Vamana is chosen
+enum class MedoidStrategy{
+    Random,         // A random node, O(1)
+    Exact           // The node with the smallest sum of distances, O(n^2)
+};
+
+// Order of the node ids after the build, so that nodes that are visited together are close in memory
+enum class ReorderStrategy{
+    None,           // Ids of the input file
+    BFS,            // Breadth first search from the medoid
+    RCM,            // Reverse Cuthill-McKee
+    Gorder          // Greedy order by shared edges and in-neighbours with the last nodes
+};
+
+// Build and search options that are chosen at runtime, so that one binary can run every mode
+struct RuntimeConfig{
+    int threads = 0;                                        // 0 keeps the OpenMP default
+    ParallelStrategy parallel = ParallelStrategy::Build;
+    MedoidStrategy medoid = MedoidStrategy::Random;
+    bool precompute_build = true;                           // Distances of an inserted point to all the points are computed in parallel up front
+    bool precompute_search = false;                         // Same for every query
+    int stitch_random_edges = -1;                           // Random edges kept by stitchedVamana, -1 for R / 2
+
+    // Benchmark mode that replays every query of the file
+    bool benchmark = false;
+    int workers = 1;                                        // Threads that run queries
+    double arrival_rate = 0.0;                              // Queries per second, 0 sends a query as soon as a worker is free
+    int search_batch = 1;                                   // Unfiltered queries that a thread searches together, 1 for one at a time (batches are experimental)
+
+    // Sweep that runs every query for every L and k on the same index and saves a CSV
+    std::string sweep_file;                                 // Empty if there is no sweep
+    std::vector<int> sweep_L;
+    std::vector<int> sweep_k = {10};
+
+    std::string memory_log;                                 // CSV of the resident memory sampled during the build, empty for none
+    ReorderStrategy reorder = ReorderStrategy::None;
+
+    bool parallelBuild() const{
+        return this->parallel != ParallelStrategy::Serial;
+    }
+
+    bool parallelAll() const{
+        return this->parallel == ParallelStrategy::Full;
+    }
+
+    int numThreads() const{
+        #if defined(_OPENMP)
+            return this->threads > 0 ? this->threads : omp_get_max_threads();
+        #else
+            return 1;
+        #endif
+    }
+};
+
+inline ParallelStrategy parseParallelStrategy(const std::string& value){
+    if(value == "serial") return ParallelStrategy::Serial;
+    if(value == "build") return ParallelStrategy::Build;
+    if(value == "full") return ParallelStrategy::Full;
+    throw std::invalid_argument("Invalid parallel strategy " + value);
+}
+
+inline MedoidStrategy parseMedoidStrategy(const std::string& value){
+    if(value == "random") return MedoidStrategy::Random;
+    if(value == "exact") return MedoidStrategy::Exact;
+    throw std::invalid_argument("Invalid medoid strategy " + value);
+}
+
+inline ReorderStrategy parseReorderStrategy(const std::string& value){
+    if(value == "none") return ReorderStrategy::None;
+    if(value == "bfs") return ReorderStrategy::BFS;
+    if(value == "rcm") return ReorderStrategy::RCM;
+    if(value == "gorder") return ReorderStrategy::Gorder;
+    throw std::invalid_argument("Invalid reorder strategy " + value);
+}
+
+#endif // config.h
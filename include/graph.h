@@ -41,7 +41,13 @@ public:
     void printGraph();
 
     std::size_t getNumberOfNodes();
-    void enforceRegular(int R);
+    void enforceRegular(int R, bool parallel = false);
+
+    // Node i becomes node new_id[i]
+    void permute(const std::vector<int>& new_id);
+
+    // Bytes of the adjacency lists
+    std::size_t memoryUsage() const;
 };
 
 #endif // graph.h
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <cstdint>
+#include <vector>
+
+#define LATENCY_SUB_BUCKET_BITS 8                               // 128 buckets in every power of two, so the error is below 1/128 (0.8%)
+
+// Histogram of latencies in nanoseconds in the style of HdrHistogram. Values below 2^LATENCY_SUB_BUCKET_BITS
+// have their own bucket and every following power of two is split into 2^(LATENCY_SUB_BUCKET_BITS - 1) buckets,
+// so every percentile has the same relative error and the histogram stays a few KB for any range.
+class LatencyHistogram{
+private:
+    std::vector<uint64_t> counts;
+    uint64_t total_count = 0;
+    uint64_t max_value = 0;
+    double sum = 0.0;
+
+    static std::size_t bucketIndex(uint64_t value);
+    static uint64_t bucketHighest(std::size_t index);
+public:
+    void record(uint64_t value);
+    void merge(const LatencyHistogram& other);
+
+    // Value at or below which percentile % of the values are, e.g. percentile(99.9)
+    uint64_t percentile(double percentile) const;
+    uint64_t count() const;
+    uint64_t max() const;
+    double mean() const;
+};
+
+#endif // latency.h
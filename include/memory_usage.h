@@ -0,0 +1,101 @@
+#ifndef MEMORY_USAGE_H
+#define MEMORY_USAGE_H
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#define RSS_SAMPLE_INTERVAL_MS 100
+
+// Bytes of the containers, counted from their capacity. Nodes of the hash containers are counted with the
+// layout of libstdc++ (next pointer, value and the hash, which is cached unless std::hash of a number is used)
+// rounded up to the 16 bytes of malloc.
+inline std::size_t allocationBytes(std::size_t bytes){
+    return (bytes + 15) / 16 * 16;
+}
+
+template <typename T>
+std::size_t vectorBytes(const std::vector<T>& v){
+    return v.capacity() * sizeof(T);
+}
+
+template <typename T>
+std::size_t nestedVectorBytes(const std::vector<std::vector<T>>& v){
+    std::size_t bytes = vectorBytes(v);
+    for(const auto& inner : v){
+        bytes += allocationBytes(vectorBytes(inner));
+    }
+    return bytes;
+}
+
+template <typename Key, typename Hash>
+constexpr bool cachedHash(){
+    return !(std::is_arithmetic<Key>::value && std::is_same<Hash, std::hash<Key>>::value);
+}
+
+template <typename Value>
+std::size_t hashNodeBytes(std::size_t size, std::size_t bucket_count, bool cached_hash){
+    std::size_t node = sizeof(void*) + sizeof(Value) + (cached_hash ? sizeof(std::size_t) : 0);
+    return size * allocationBytes(node) + bucket_count * sizeof(void*);
+}
+
+template <typename Key, typename Hash>
+std::size_t hashSetBytes(const std::unordered_set<Key, Hash>& set){
+    return hashNodeBytes<Key>(set.size(), set.bucket_count(), cachedHash<Key, Hash>());
+}
+
+template <typename Key, typename Value, typename Hash>
+std::size_t hashMapBytes(const std::unordered_map<Key, Value, Hash>& map){
+    return hashNodeBytes<std::pair<const Key, Value>>(map.size(), map.bucket_count(), cachedHash<Key, Hash>());
+}
+
+// Bytes of every part of an index, in the order they were added
+struct MemoryReport{
+    std::vector<std::pair<std::string, std::size_t>> parts;
+
+    void add(const std::string& name, std::size_t bytes){
+        this->parts.push_back(std::make_pair(name, bytes));
+    }
+
+    std::size_t total() const{
+        std::size_t bytes = 0;
+        for(const auto& part : this->parts){
+            bytes += part.second;
+        }
+        return bytes;
+    }
+
+    void print() const;
+};
+
+// Resident set size of the process from /proc/self/statm and its peak from VmHWM of /proc/self/status
+std::size_t currentRss();
+std::size_t peakRss();
+
+// Thread that samples the resident set size every interval until it is stopped
+class RssSampler{
+private:
+    std::thread sampler;
+    std::atomic<bool> running{false};
+    std::mutex samples_mutex;
+    std::vector<std::pair<double, std::size_t>> samples;    // Seconds since start and bytes
+    std::size_t peak = 0;
+public:
+    ~RssSampler();
+
+    void start(int interval_ms = RSS_SAMPLE_INTERVAL_MS);
+    void stop();
+
+    std::size_t peakBytes();
+    std::vector<std::pair<double, std::size_t>> getSamples();
+    void save(const std::string& file_path);                // CSV with seconds and MB
+};
+
+#endif // memory_usage.h
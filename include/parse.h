@@ -6,10 +6,12 @@
 #include <vector>
 #include <string>
 #include <stdexcept>
+#include <utility>
 
 // Parse for bin extension
-void parseDataVector(const std::string& path, std::vector<float>& vec_with_category_values, std::vector<std::vector<float>>& vec_with_points);
-void parseQueryVector(const std::string& path, std::vector<float>& query_filters, std::vector<std::vector<float>>& query_points);
+// Query types are 0 for vector only, 1 for filter, 2 for timestamp range and 3 for filter and timestamp range
+void parseDataVector(const std::string& path, std::vector<float>& vec_with_category_values, std::vector<float>& vec_with_timestamps, std::vector<std::vector<float>>& vec_with_points);
+void parseQueryVector(const std::string& path, std::vector<int>& query_types, std::vector<float>& query_filters, std::vector<std::pair<float, float>>& query_ranges, std::vector<std::vector<float>>& query_points);
 
 // Parse for fvecs, ivecs and bvecs extensions
 template <typename datatype>
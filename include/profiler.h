@@ -0,0 +1,123 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <string>
+
+// Hot parts of the insertion of a point. They run once per point, so they are added to totals
+// instead of getting a trace event each.
+enum class ProfilePhase{
+    Greedy,         // Search for the candidates of the point
+    Prune,          // robustPrune of the point
+    Reverse,        // Reverse edges and the pruning of the neighbours that get too many
+    Count
+};
+
+// Hardware counters of the calling thread, zero if they are off or perf_event_open is not allowed
+struct ProfileCounters{
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t llc_misses = 0;
+};
+
+struct ProfileTotals{
+    uint64_t calls = 0;
+    double time_us = 0.0;
+    ProfileCounters counters;
+};
+
+// Build profiler that saves the scopes as a Chrome trace for chrome://tracing or ui.perfetto.dev. It is off
+// until start is called. Every thread keeps its own events and phase totals, and with hardware counters it
+// opens its own perf_event_open group, so the counters of a scope cover only the thread that ran it.
+class Profiler{
+private:
+    static inline bool active = false;
+public:
+    static void start(bool hardware_counters);
+    static void stop();                                     // Drops everything that was recorded
+    static bool enabled(){ return active; }
+    static bool hardwareCounters();
+
+    // Microseconds since start and the counters of the calling thread
+    static double now();
+    static ProfileCounters readCounters();
+
+    static void addEvent(const char* name, double start_us, double duration_us, const ProfileCounters& counters, const ProfileTotals* phases_before);
+    static void addPhase(ProfilePhase phase, double duration_us, const ProfileCounters& counters);
+    static void threadPhases(ProfileTotals* phases);       // Totals of the calling thread for every phase
+
+    // Sum of the totals of every thread
+    static ProfileTotals phaseTotals(ProfilePhase phase);
+
+    static void save(const std::string& file_path);
+    static void printSummary();
+};
+
+// Trace event for the lifetime of the scope, with the counters and the phase totals of the scope as arguments
+class ProfileScope{
+private:
+    const char* name;
+    bool active;
+    double start_us = 0.0;
+    ProfileCounters start_counters;
+    ProfileTotals start_phases[(int)ProfilePhase::Count];
+public:
+    explicit ProfileScope(const char* name) : name(name), active(Profiler::enabled()){
+        if(!this->active)
+            return;
+
+        Profiler::threadPhases(this->start_phases);
+        this->start_counters = Profiler::readCounters();
+        this->start_us = Profiler::now();
+    }
+
+    ~ProfileScope(){
+        if(this->active)
+            Profiler::addEvent(this->name, this->start_us, Profiler::now() - this->start_us, this->start_counters, this->start_phases);
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+// Adds the time and the counters of the scope to the totals of a phase. next ends the current phase and
+// starts another one, so that the steps of an insertion need a single timer.
+class ProfilePhaseTimer{
+private:
+    ProfilePhase phase;
+    bool active;
+    double start_us = 0.0;
+    ProfileCounters start_counters;
+public:
+    explicit ProfilePhaseTimer(ProfilePhase phase) : phase(phase), active(Profiler::enabled()){
+        if(!this->active)
+            return;
+
+        this->start_counters = Profiler::readCounters();
+        this->start_us = Profiler::now();
+    }
+
+    void next(ProfilePhase phase){
+        if(!this->active)
+            return;
+
+        Profiler::addPhase(this->phase, Profiler::now() - this->start_us, this->start_counters);
+        this->phase = phase;
+        this->start_counters = Profiler::readCounters();
+        this->start_us = Profiler::now();
+    }
+
+    ~ProfilePhaseTimer(){
+        if(this->active)
+            Profiler::addPhase(this->phase, Profiler::now() - this->start_us, this->start_counters);
+    }
+
+    ProfilePhaseTimer(const ProfilePhaseTimer&) = delete;
+    ProfilePhaseTimer& operator=(const ProfilePhaseTimer&) = delete;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+
+#endif // profiler.h
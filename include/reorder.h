@@ -0,0 +1,28 @@
+#ifndef REORDER_H
+#define REORDER_H
+
+#include <vector>
+#include "graph.h"
+
+#define GORDER_WINDOW 5                 // Last placed nodes that the score of a candidate is counted against
+
+// Orders of the nodes of a graph that give close ids to nodes that a search visits together.
+// order[i] is the old id of the node that becomes node i.
+
+// Breadth first search from start. Nodes that it can't reach continue from the smallest unvisited id.
+std::vector<int> bfsOrder(Graph& G, int start);
+
+// Breadth first search from every start node in turn, e.g. the start nodes of the labels of a filtered graph
+std::vector<int> bfsOrder(Graph& G, const std::vector<int>& starts);
+
+// Reverse Cuthill-McKee. Every component starts from its node with the fewest in and out edges and the
+// neighbours of a node are visited from the smallest degree up.
+std::vector<int> rcmOrder(Graph& G);
+
+// Gorder, the node with the most edges and common in-neighbours with the last window nodes comes next
+std::vector<int> gorderOrder(Graph& G, int window = GORDER_WINDOW);
+
+// New id of every old id. Throws if order is not a permutation.
+std::vector<int> inverseOrder(const std::vector<int>& order);
+
+#endif // reorder.h
@@ -0,0 +1,70 @@
+#ifndef SCRATCH_H
+#define SCRATCH_H
+
+#include <cstddef>
+#include <functional>
+#include <memory_resource>
+#include <optional>
+#include <set>
+#include <unordered_set>
+#include <vector>
+
+// Sets of one insertion of the build, allocated from a ScratchArena
+template <typename Compare>
+using ScratchSet = std::pmr::set<int, Compare>;
+using ScratchVisited = std::pmr::unordered_set<int>;
+
+// Visited set of a search that allocates like its result set, std::allocator<int> or the arena
+template <typename Allocator>
+using VisitedSet = std::unordered_set<int, std::hash<int>, std::equal_to<int>, Allocator>;
+
+// Memory of the sets and the distance map of one insertion. Everything is allocated from a monotonic buffer,
+// so an allocation is a pointer bump and nothing is freed one by one, and reset makes the whole buffer free
+// for the next insertion. If an insertion needs more than the buffer, reset grows it to the bytes that the
+// insertion used, so that the next insertions don't call malloc at all. The arenas of the build threads are
+// released when the build ends, so that they don't stay resident while the queries run.
+class ScratchArena{
+private:
+    // Passes the allocations to next and counts their bytes, with the padding of the alignment
+    class Counter : public std::pmr::memory_resource{
+    public:
+        std::pmr::memory_resource* next = nullptr;
+        std::size_t bytes = 0;
+    protected:
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+    };
+
+    std::vector<std::byte> buffer;
+    Counter used;                                           // Bytes that the current insertion asked for
+    Counter overflow;                                       // Bytes that the buffer got from the heap, when it was full
+    std::optional<std::pmr::monotonic_buffer_resource> resource;
+
+    void rebuild(std::size_t bytes);
+public:
+    explicit ScratchArena(std::size_t bytes = 0);
+
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    std::pmr::memory_resource* get();
+
+    // Frees everything allocated since the last reset. Nothing that was allocated from the arena may be used after it.
+    void reset();
+
+    // Frees the buffer too and returns its size
+    std::size_t release();
+
+    std::size_t capacity() const;
+
+    // Arena of the calling thread. A task resets it when it starts an insertion, which never waits for other
+    // tasks, so a thread never runs two insertions on its arena at the same time.
+    static ScratchArena& local();
+
+    // Releases the arenas of the calling thread and of the threads of a parallel region with the given threads,
+    // when it isn't called from a parallel region. Returns the size of the largest one.
+    static std::size_t releaseAll(int threads);
+};
+
+#endif // scratch.h
@@ -0,0 +1,39 @@
+#ifndef SEARCH_STATS_H
+#define SEARCH_STATS_H
+
+#include <cstddef>
+#include <chrono>
+
+// Counters of a single search, used to tell if a slower search comes from the graph (more expansions),
+// the distances (more computations per expansion) or the memory (more time for the same work).
+// They are filled only when the code is compiled with SEARCH_STATS, otherwise the code that
+// updates them compiles to nothing.
+struct SearchStats{
+    std::size_t expansions = 0;                             // Nodes taken from the candidates and expanded
+    std::size_t distances = 0;                              // Distance computations, the cached ones are not counted
+    std::size_t prunes = 0;                                 // Times NNS was cut down to the search list size
+    std::size_t visited = 0;                                // Size of the Visited set at the end
+    double time_us = 0.0;                                   // Wall time of the search in microseconds
+};
+
+#if defined(SEARCH_STATS)
+#define STATS_ONLY(...) __VA_ARGS__
+
+// Distances calculated by this thread. The sets of a search hold copies of the comparator,
+// so the count is kept here and a search reads it before and after.
+inline thread_local std::size_t search_distance_count = 0;
+
+// Set the counters that are known only when the search returns
+inline void finishSearchStats(SearchStats* stats, std::chrono::steady_clock::time_point start, std::size_t distances, std::size_t visited){
+    if(stats == nullptr)
+        return;
+
+    stats->distances += distances;
+    stats->visited = visited;
+    stats->time_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+#else
+#define STATS_ONLY(...)
+#endif
+
+#endif // search_stats.h
@@ -0,0 +1,68 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include "config.h"
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+// Run run(i) for every i in [0, n) as OpenMP tasks, starting from the task with the highest cost.
+// A thread that finishes its task takes the next one, so the large tasks start first and the small
+// ones fill the gaps at the end. A task can call parallelFor to split its own work over the same threads.
+// Without a parallel build the tasks run in the same order on the calling thread.
+template <typename Cost, typename Run>
+void parallelTasks(std::size_t n, Cost cost, Run run, const RuntimeConfig& config){
+    std::vector<std::size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b){ return cost(a) > cost(b); });
+
+    if(!config.parallelBuild()){
+        for(std::size_t i : order){
+            run(i);
+        }
+        return;
+    }
+
+    #pragma omp parallel num_threads(config.numThreads())
+    #pragma omp single
+    for(std::size_t i : order){
+        #pragma omp task firstprivate(i)
+        run(i);
+    }
+}
+
+// Parallel loop over [0, n) with at least grain iterations per task. Inside parallelTasks or another
+// parallel region the loop becomes tasks of the threads that already run, otherwise a parallel region
+// is started for it. Returns when all the iterations are done.
+template <typename Body>
+void parallelFor(std::size_t n, std::size_t grain, Body body, const RuntimeConfig& config){
+    grain = std::max<std::size_t>(grain, 1);
+
+    if(!config.parallelBuild()){
+        for(std::size_t i = 0; i < n; i++){
+            body(i);
+        }
+        return;
+    }
+
+    if(omp_in_parallel()){
+        #pragma omp taskloop grainsize(grain)
+        for(std::size_t i = 0; i < n; i++){
+            body(i);
+        }
+        return;
+    }
+
+    #pragma omp parallel num_threads(config.numThreads())
+    #pragma omp single
+    #pragma omp taskloop grainsize(grain)
+    for(std::size_t i = 0; i < n; i++){
+        body(i);
+    }
+}
+
+#endif // task_pool.h
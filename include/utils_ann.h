@@ -5,10 +5,24 @@
 #include <string>
 #include <cmath>
 #include <vector>
+#include <memory>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <memory_resource>
+#include "search_stats.h"
 
 #define FNV_BASIS 0x811c9dc5
 #define FNV_PRIME 0x01000193
 
+#define PREFETCH_LINES 8                // Cache lines of a vector that are prefetched before its distance is computed
+#define DISTANCE_LANES 4                // Partial sums of a distance, so that an addition doesn't wait for the one before it
+
+// Dimensions of the common datasets, whose distance loops are compiled for the exact number of coordinates.
+// The compiler unrolls and vectorizes them without a remainder, every other dimension runs the same loops with
+// the dimension read at runtime.
+#define FIXED_DIMENSIONS 96, 100, 128, 256, 768, 960
+
 // FVN-1 Hash Function.
 template <typename datatype>
 struct VectorHash{
@@ -23,58 +37,305 @@ struct VectorHash{
     }
 };
 
+#define UNKNOWN_DISTANCE (std::numeric_limits<float>::infinity())    // Distance that is not computed yet
+
+// Metrics of the index, given to ANN and CompareVectors as a template parameter so that the inner loops call
+// them directly. A distance adds term(a[i], b[i]) over the coordinates and finish turns the sum into a float
+// that is smaller for closer points and never infinite. relax is the distance scaled by alpha in the prune rule.
+
+// Squared Euclidean distance
+struct L2Metric{
+    static constexpr const char* name = "l2";
+    static constexpr bool normalized = false;              // Points and queries are scaled to unit length at ingest
+    using MedoidMetric = L2Metric;                         // Metric of the sums of distances that choose the medoid
+
+    // The difference is taken in the type of the coordinates, as it always was
+    template <typename datatype>
+    static inline double term(datatype a, datatype b){
+        double diff = a - b;
+        return diff * diff;
+    }
+
+    static inline float finish(double sum){
+        return sum > std::numeric_limits<float>::max() ? std::numeric_limits<float>::max() : (float)sum;
+    }
+
+    static inline float relax(float alpha, float distance){
+        return alpha * distance;
+    }
+};
+
+// Minus the inner product, for maximum inner product search. The point with the smallest sum of these distances
+// is the one with the largest projection on the sum of the points, an extreme point instead of a central one,
+// so the medoid is chosen with L2.
+struct InnerProductMetric{
+    static constexpr const char* name = "ip";
+    static constexpr bool normalized = false;
+    using MedoidMetric = L2Metric;
+
+    template <typename datatype>
+    static inline double term(datatype a, datatype b){
+        return (double)a * b;
+    }
+
+    static inline float finish(double sum){
+        return (float)std::clamp(-sum, -(double)std::numeric_limits<float>::max(), (double)std::numeric_limits<float>::max());
+    }
+
+    // alpha > 1 makes the prune keep more edges, also for negative distances
+    static inline float relax(float alpha, float distance){
+        return distance >= 0.0f ? alpha * distance : distance / alpha;
+    }
+};
+
+// One minus the cosine similarity, which is one minus the inner product of the normalized vectors
+struct CosineMetric{
+    static constexpr const char* name = "cosine";
+    static constexpr bool normalized = true;
+    using MedoidMetric = CosineMetric;
+
+    template <typename datatype>
+    static inline double term(datatype a, datatype b){
+        return (double)a * b;
+    }
+
+    static inline float finish(double sum){
+        return (float)(1.0 - sum);
+    }
+
+    static inline float relax(float alpha, float distance){
+        return alpha * distance;
+    }
+};
+
+// Calls kernel with std::integral_constant<std::size_t, dim> if dim is one of the fixed dimensions and with
+// std::integral_constant<std::size_t, 0> otherwise, in which case the kernel uses dim
+template <std::size_t D, std::size_t... Rest, typename Kernel>
+inline decltype(auto) dispatchDimension(std::size_t dim, Kernel&& kernel){
+    if(dim == D)
+        return kernel(std::integral_constant<std::size_t, D>());
+    if constexpr (sizeof...(Rest) > 0)
+        return dispatchDimension<Rest...>(dim, kernel);
+    else
+        return kernel(std::integral_constant<std::size_t, 0>());
+}
+
+// Adds coordinate i to the partial sum i % DISTANCE_LANES and the partial sums in order at the end.
+// D is the dimension if it is known at compile time and 0 if it isn't. The fixed dimensions are multiples of
+// DISTANCE_LANES, so their loops have no remainder.
+template <typename Metric, std::size_t D, typename datatype>
+inline double laneSum(const datatype* a, const datatype* b, std::size_t dim){
+    const std::size_t n = D != 0 ? D : dim;
+    double sums[DISTANCE_LANES] = {};
+
+    std::size_t i = 0;
+    for(; i + DISTANCE_LANES <= n; i += DISTANCE_LANES){
+        for(std::size_t lane = 0; lane < DISTANCE_LANES; lane++){
+            sums[lane] += Metric::term(a[i + lane], b[i + lane]);
+        }
+    }
+    if constexpr (D % DISTANCE_LANES != 0 || D == 0){
+        for(std::size_t lane = 0; lane < DISTANCE_LANES && i + lane < n; lane++){
+            sums[lane] += Metric::term(a[i + lane], b[i + lane]);
+        }
+    }
+
+    double sum = sums[0];
+    for(std::size_t lane = 1; lane < DISTANCE_LANES; lane++){
+        sum += sums[lane];
+    }
+    return sum;
+}
+
+// Sum of the terms of the metric over the coordinates, before finish
+template <typename Metric, typename datatype>
+inline double metricSum(const datatype* a, const datatype* b, std::size_t dim){
+    return dispatchDimension<FIXED_DIMENSIONS>(dim, [&](auto fixed){
+        return laneSum<Metric, decltype(fixed)::value>(a, b, dim);
+    });
+}
+
+// Distance of the metric between two vectors
+template <typename Metric, typename datatype>
+inline float metricDistance(const std::vector<datatype>& a, const std::vector<datatype>& b, std::size_t dim){
+    return Metric::finish(metricSum<Metric>(a.data(), b.data(), dim));
+}
+
 // Utility function to calculate the squared Euclidean distance between two vectors
 template <typename datatype>
 inline float calculateDistance(const std::vector<datatype>& a, const std::vector<datatype>& b, std::size_t dim){
-    double distance = 0.0;
-    float max_float = std::numeric_limits<float>::max();
+    return metricDistance<L2Metric>(a, b, dim);
+}
 
-    // Parallelize this loop
-    for(std::size_t i = 0; i < dim; i++){
-        double diff = a[i] - b[i];
-        distance += diff * diff;
-        if(distance > max_float){
-            return max_float;
-        }
+// Scale a vector to unit length for the cosine metric, a zero vector stays zero
+template <typename datatype>
+inline void normalizeVector(std::vector<datatype>& v){
+    static_assert(std::is_floating_point<datatype>::value, "normalizeVector: Only floating point vectors can be normalized");
+
+    double norm = 0.0;
+    for(datatype coordinate : v){
+        norm += (double)coordinate * coordinate;
     }
-    return (float)(distance);
+    if(norm == 0.0)
+        return;
+
+    norm = std::sqrt(norm);
+    for(datatype& coordinate : v){
+        coordinate = (datatype)(coordinate / norm);
+    }
+}
+
+// Prefetch the first cache lines of a vector, so that its distance doesn't wait for memory
+template <typename datatype>
+inline void prefetchVector(const std::vector<datatype>& v){
+    const char* data = reinterpret_cast<const char*>(v.data());
+    std::size_t lines = std::min<std::size_t>((v.size() * sizeof(datatype) + 63) / 64, PREFETCH_LINES);
+    for(std::size_t line = 0; line < lines; line++){
+        __builtin_prefetch(data + line * 64);
+    }
+}
+
+// Distances of count points to the query, with the kernel of the dimension chosen once for all of them.
+// The partial sums of a point already keep the core busy, so the points are computed one after the other
+// and the loads of the next point overlap with the additions of the current one.
+template <typename datatype, typename Metric = L2Metric>
+inline void calculateDistances(const std::vector<datatype>& query, const std::vector<datatype>* const* points, std::size_t count, std::size_t dim, float* distances){
+    const datatype* q = query.data();
+
+    dispatchDimension<FIXED_DIMENSIONS>(dim, [&](auto fixed){
+        for(std::size_t j = 0; j < count; j++){
+            distances[j] = Metric::finish(laneSum<Metric, decltype(fixed)::value>(points[j]->data(), q, dim));
+        }
+    });
 }
 
 
 // Comparator class for comparing indices based on the distance from a query point
-template <typename datatype>
+template <typename datatype, typename Metric = L2Metric>
 class CompareVectors{
 private:
     const std::vector<std::vector<datatype>>& m_node_to_point_map;      // Map from index to vector
-    mutable std::vector<float> distance_map;                // Map from index to distance if it is calculated
-    const std::vector<datatype>& m_compare_vector;                      // The query point to compare distances to
+
+    // Map from index to distance if it is calculated. The sets copy their comparator, so the copies share
+    // the map and a distance is computed once for all the sets of a query.
+    std::shared_ptr<std::pmr::vector<float>> distances;
+    float* distance_map;
+    const std::vector<datatype>* m_compare_vector;                      // The query point to compare distances to
+    std::shared_ptr<std::vector<datatype>> normalized_query;            // Normalized copy of the query if the metric needs it
     std::size_t dimension;
+    const std::vector<int>* m_local_index = nullptr;                    // Map from index to position in distance map for sub-graphs
+
+    // Position of a node in the distance map
+    inline std::size_t slot(int a) const {
+        return m_local_index == nullptr ? a : (*m_local_index)[a];
+    }
+
+    void setQuery(const std::vector<datatype>& compare_vector){
+        if(m_node_to_point_map.empty()){
+            throw std::invalid_argument("Node to point map is empty");
+        }
+
+        if(compare_vector.size() != m_node_to_point_map[0].size()){
+            throw std::invalid_argument("Query vector size does not match the data vector size");
+        }
+
+        if constexpr(Metric::normalized){
+            normalized_query = std::make_shared<std::vector<datatype>>(compare_vector);
+            normalizeVector(*normalized_query);
+            m_compare_vector = normalized_query.get();
+        }
+        else{
+            m_compare_vector = &compare_vector;
+        }
+    }
+
+    inline float distance(int node) const {
+        return metricDistance<Metric>(m_node_to_point_map[node], *m_compare_vector, dimension);
+    }
 
 public:
-    // Constructor now takes node-to-point map and a comparison vector
+    // Constructor now takes node-to-point map and a comparison vector. The distance map is allocated from resource,
+    // e.g. the scratch arena of an insertion of the build.
     CompareVectors(const std::vector<std::vector<datatype>>& node_to_point_map, 
-                   const std::vector<datatype>& compare_vector, bool precalculate = false)
-        : m_node_to_point_map(node_to_point_map), m_compare_vector(compare_vector), dimension(compare_vector.size()){
-            if(m_node_to_point_map.empty()){
-                throw std::invalid_argument("Node to point map is empty");
-            }
-            
-            if(m_compare_vector.size() != m_node_to_point_map[0].size()){
-                throw std::invalid_argument("Query vector size does not match the data vector size");
-            }
-            
-            // Initialize the distance map with negative values
-            distance_map.resize(m_node_to_point_map.size(), -1.0f);
+                   const std::vector<datatype>& compare_vector, bool precalculate = false,
+                   std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_node_to_point_map(node_to_point_map), dimension(compare_vector.size()){
+            setQuery(compare_vector);
+
+            // Initialize the distance map with unknown distances
+            distances = std::make_shared<std::pmr::vector<float>>(m_node_to_point_map.size(), UNKNOWN_DISTANCE, resource);
+            distance_map = distances->data();
 
             // Precalculate the distances using parallelaization if the flag is set
             if(precalculate){
                 #pragma omp parallel for schedule(dynamic)
                 for(std::size_t i = 0; i < m_node_to_point_map.size(); i++){
-                    distance_map[i] = calculateDistance(m_node_to_point_map[i], m_compare_vector, dimension);
+                    distance_map[i] = distance(i);
                 }
+                STATS_ONLY(search_distance_count += m_node_to_point_map.size();)
             }
         }
 
+    // Constructor for comparing only the nodes of a sub-graph. The distance map has one entry for every
+    // node of the sub-graph and local_index maps a node to its position in the sub-graph.
+    CompareVectors(const std::vector<std::vector<datatype>>& node_to_point_map, 
+                   const std::vector<datatype>& compare_vector, const std::vector<int>& local_index, std::size_t local_size,
+                   std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_node_to_point_map(node_to_point_map), dimension(compare_vector.size()), m_local_index(&local_index){
+            setQuery(compare_vector);
+
+            distances = std::make_shared<std::pmr::vector<float>>(local_size, UNKNOWN_DISTANCE, resource);
+            distance_map = distances->data();
+        }
+
+    // Prefetch the headers of the vectors of the nodes that don't have a distance yet. The address of a header
+    // doesn't depend on memory, and prefetchVectors needs the header to find the coordinates.
+    void prefetchHeaders(const std::vector<int>& nodes) const {
+        for(int node : nodes){
+            if(distance_map[slot(node)] == UNKNOWN_DISTANCE)
+                __builtin_prefetch(&m_node_to_point_map[node]);
+        }
+    }
+
+    // Prefetch the vectors of the nodes that don't have a distance yet, without computing it
+    void prefetchVectors(const std::vector<int>& nodes) const {
+        for(int node : nodes){
+            if(distance_map[slot(node)] == UNKNOWN_DISTANCE)
+                prefetchVector(m_node_to_point_map[node]);
+        }
+    }
+
+    // Compute the distances of the nodes that don't have one yet. The headers of all of them are prefetched,
+    // then their vectors, and then the distances are computed, so that the misses of the nodes overlap
+    // instead of one after another.
+    void computeDistances(const std::vector<int>& nodes) const {
+        thread_local std::vector<int> pending;
+        thread_local std::vector<const std::vector<datatype>*> vectors;
+        thread_local std::vector<float> results;
+
+        pending.clear();
+        vectors.clear();
+        for(int node : nodes){
+            if(distance_map[slot(node)] == UNKNOWN_DISTANCE){
+                __builtin_prefetch(&m_node_to_point_map[node]);
+                pending.push_back(node);
+            }
+        }
+
+        for(int node : pending){
+            const std::vector<datatype>& vector = m_node_to_point_map[node];
+            prefetchVector(vector);
+            vectors.push_back(&vector);
+        }
+
+        results.resize(pending.size());
+        calculateDistances<datatype, Metric>(*m_compare_vector, vectors.data(), pending.size(), dimension, results.data());
+        for(std::size_t i = 0; i < pending.size(); i++){
+            distance_map[slot(pending[i])] = results[i];
+        }
+        STATS_ONLY(search_distance_count += pending.size();)
+    }
+
     // Operator() compares the distances of points at indices a and b to the comparison vector.
     // If the distance of a node from the comparison vector has already been calculated, don't recalculate it.
     // If the distances are equal, compare the indices so that the set will have nodes with same distance too.
@@ -82,20 +343,24 @@ public:
         float distance_a = 0.0f;
         float distance_b = 0.0f;
 
-        if(distance_map[a] < 0.0f){ 
-            distance_a = calculateDistance(m_node_to_point_map[a], m_compare_vector, dimension);
-            distance_map[a] = distance_a;
+        float& cached_a = distance_map[slot(a)];
+        if(cached_a == UNKNOWN_DISTANCE){
+            distance_a = distance(a);
+            cached_a = distance_a;
+            STATS_ONLY(search_distance_count++;)
         } 
         else{
-            distance_a = distance_map[a];
+            distance_a = cached_a;
         }
 
-        if(distance_map[b] < 0.0f){
-            distance_b = calculateDistance(m_node_to_point_map[b], m_compare_vector, dimension);
-            distance_map[b] = distance_b;
+        float& cached_b = distance_map[slot(b)];
+        if(cached_b == UNKNOWN_DISTANCE){
+            distance_b = distance(b);
+            cached_b = distance_b;
+            STATS_ONLY(search_distance_count++;)
         }
         else{
-            distance_b = distance_map[b];
+            distance_b = cached_b;
         }
 
         if(distance_a == distance_b){
@@ -104,6 +369,5 @@ public:
 
         return distance_a < distance_b;
     }
-
 };
 #endif // ann_utils.h
\ No newline at end of file
@@ -5,6 +5,9 @@
 #include <string>
 #include "defs.h"
 #include "parse.h"
+#include "ann.h"
+
+#define GROUND_TRUTH_SIZE 100                   // Closest points kept for every query
 
 // Function to find the extension of a file
 std::string findExtension(const std::string& file_path);
@@ -12,15 +15,21 @@ std::string findExtension(const std::string& file_path);
 // Function to validate the extension of the files
 bool validateExtension(const std::string& extension_base, const std::string& extension_query, const std::string& extension_gt, const std::string& file_format);
 
-// Calculate the ground truth for the given query
-template <typename datatype>
-void calculateGroundTruth(const std::vector<std::vector<datatype>>& queries, const std::vector<std::vector<datatype>>& base_points, std::vector<std::vector<std::pair<float, int>>>& ground_truth, const std::vector<float>* query_category_values = nullptr, const std::vector<float>* base_category_values = nullptr);
+// Calculate the ground truth for the given query with the distance of Metric
+template <typename datatype, typename Metric = L2Metric>
+void calculateGroundTruth(const std::vector<std::vector<datatype>>& queries, const std::vector<std::vector<datatype>>& base_points, std::vector<std::vector<std::pair<float, int>>>& ground_truth, const std::vector<float>* query_category_values = nullptr, const std::vector<float>* base_category_values = nullptr, const std::vector<std::pair<float, float>>* query_ranges = nullptr, const std::vector<float>* base_timestamps = nullptr, const RuntimeConfig& config = RuntimeConfig());
+
+// Save the indexes of the ground truth in ivecs format
+void saveGroundTruth(const std::string& file_path, const std::vector<std::vector<std::pair<float, int>>>& ground_truth);
+
+// Print the percentiles and a histogram with power of two buckets of every counter of the searches
+void printSearchStats(const std::string& name, const std::vector<SearchStats>& stats);
 
 // Process files with bin format and run the Vamana algorithm
-void processBinFormat(const std::string& file_path_base, const std::string& file_path_query, const std::string& file_path_gt, float alpha, int R, int L, const std::string& file_path_load, const std::string& file_path_save, const std::string& algo, bool do_query, const std::string& file_path_log);
+void processBinFormat(const std::string& file_path_base, const std::string& file_path_query, const std::string& file_path_gt, float alpha, int R, int L, const std::string& file_path_load, const std::string& file_path_save, const std::string& algo, bool do_query, const std::string& file_path_log, bool nn_descent = false, const std::vector<VamanaPass>& passes = {}, int bridges = 0, const RuntimeConfig& config = RuntimeConfig());
 
-// Process files with vec format and run the Vamana algorithm
-template <typename datatype>
-void processVecFormat(const std::string& file_path_base, const std::string& file_path_query, const std::string& file_path_gt, float alpha, int R, int L, const std::string& file_path_load, const std::string& file_path_save, bool do_query, const std::string& file_path_log);
+// Process files with vec format and run the Vamana algorithm with the distance of Metric
+template <typename datatype, typename Metric = L2Metric>
+void processVecFormat(const std::string& file_path_base, const std::string& file_path_query, const std::string& file_path_gt, float alpha, int R, int L, const std::string& file_path_load, const std::string& file_path_save, bool do_query, const std::string& file_path_log, bool nn_descent = false, const std::vector<VamanaPass>& passes = {}, const RuntimeConfig& config = RuntimeConfig());
 
 #endif // utils.h
\ No newline at end of file
@@ -1,13 +1,16 @@
 #include "ann.h"
 #include "defs.h"
+#include "task_pool.h"
+#include "profiler.h"
+#include "reorder.h"
 #include <filesystem>
 #include <omp.h>
 namespace fs = std::filesystem;
 
 // Prune the set to retain only the k closest points
-template <typename datatype>
-template <typename Compare>
-void ANN<datatype>::pruneSet(std::set<int, Compare>& myset, std::set<int, Compare>& diff, int k){
+template <typename datatype, typename Metric>
+template <typename Compare, typename Allocator>
+void ANN<datatype, Metric>::pruneSet(std::set<int, Compare, Allocator>& myset, std::set<int, Compare, Allocator>& diff, int k){
 
     if(myset.size() <= static_cast<std::size_t>(k))
         return;
@@ -25,8 +28,8 @@ void ANN<datatype>::pruneSet(std::set<int, Compare>& myset, std::set<int, Compar
 }
 
 // Return the neighbors of a point
-template <typename datatype>
-void ANN<datatype>::neighbourNodes(const int& point, std::vector<int>& neighbours){
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::neighbourNodes(const int& point, std::vector<int>& neighbours){
 
     // Retrieve the node index for the point
     std::unordered_set<int>& neighbour_indices = this->G->getNeighbours(point);
@@ -37,15 +40,15 @@ void ANN<datatype>::neighbourNodes(const int& point, std::vector<int>& neighbour
 
 }
 
-template <typename datatype>
-bool ANN<datatype>::checkFilters(){
+template <typename datatype, typename Metric>
+bool ANN<datatype, Metric>::checkFilters(){
 
     for(size_t i = 0; i < this->node_to_point_map.size(); i++){
         // Get the neighbors of the point
         std::vector<int> neighbours;
         this->neighbourNodes(i, neighbours);
         for(int neighbour : neighbours){
-            if(this->node_to_filter_map[i] != this->node_to_filter_map[neighbour]){
+            if(!this->shareLabel(i, neighbour)){
                 return false;
             }
         }
@@ -54,49 +57,53 @@ bool ANN<datatype>::checkFilters(){
     return true;
 }
 
-template <typename datatype>
-int ANN<datatype>::countNeighbours(int node){
+template <typename datatype, typename Metric>
+int ANN<datatype, Metric>::countNeighbours(int node){
     return this->G->countNeighbours(node);
 }
 
+// Scale the points to unit length once, so that the cosine metric is an inner product in the searches
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::normalizePoints(){
+    if constexpr(Metric::normalized){
+        for(auto& point : this->node_to_point_map){
+            normalizeVector(point);
+        }
+    }
+}
+
 // Constructor for building a random graph
-template <typename datatype>
-ANN<datatype>::ANN(const std::vector<std::vector<datatype>>& points){
-    int node_index = 0;
+// The constructors that take the points by reference copy them once and move the copy in, so that callers
+// that don't need the points any more can move them in without a copy
+template <typename datatype, typename Metric>
+ANN<datatype, Metric>::ANN(const std::vector<std::vector<datatype>>& points) : ANN(std::vector<std::vector<datatype>>(points)){}
 
+template <typename datatype, typename Metric>
+ANN<datatype, Metric>::ANN(std::vector<std::vector<datatype>>&& points){
     this->G = new Graph(points.size());  // Call the Graph constructor with number of points
-    // Populate the node_to_point_map and point_to_node_map
-    for(const auto& point : points){
-        this->node_to_point_map.push_back(point);
-        this->point_to_node_map[point] = node_index;
-        node_index++;
-    }
+    this->node_to_point_map = std::move(points);
+    this->normalizePoints();
 }
 
-template <typename datatype>
-ANN<datatype>::ANN(const std::vector<std::vector<datatype>>& points, size_t reg){
-    int node_index = 0;
+template <typename datatype, typename Metric>
+ANN<datatype, Metric>::ANN(const std::vector<std::vector<datatype>>& points, size_t reg) : ANN(std::vector<std::vector<datatype>>(points), reg){}
 
+template <typename datatype, typename Metric>
+ANN<datatype, Metric>::ANN(std::vector<std::vector<datatype>>&& points, size_t reg){
     this->G = new Graph(points.size(), reg);  // Call the Graph constructor with number of points
-    // Populate the node_to_point_map and point_to_node_map
-    for(const auto& point : points){
-        this->node_to_point_map.push_back(point);
-        this->point_to_node_map[point] = node_index;
-        node_index++;
-    }
+    this->node_to_point_map = std::move(points);
+    this->normalizePoints();
 }
 
-template <typename datatype>
-ANN<datatype>::ANN(const std::vector<std::vector<datatype>>& points, const std::vector<std::unordered_set<int>>& edges) {
-    std::size_t num_nodes = points.size();
-
-    int node_index = 0;
+template <typename datatype, typename Metric>
+ANN<datatype, Metric>::ANN(const std::vector<std::vector<datatype>>& points, const std::vector<std::unordered_set<int>>& edges)
+    : ANN(std::vector<std::vector<datatype>>(points), edges){}
 
-    for(const auto& point : points){
-        this->node_to_point_map.push_back(point);
-        this->point_to_node_map[point] = node_index;
-        node_index++;
-    }
+template <typename datatype, typename Metric>
+ANN<datatype, Metric>::ANN(std::vector<std::vector<datatype>>&& points, const std::vector<std::unordered_set<int>>& edges) {
+    std::size_t num_nodes = points.size();
+    this->node_to_point_map = std::move(points);
+    this->normalizePoints();
 
     if(edges.empty() || edges.size() != num_nodes){
         this->G = new Graph(num_nodes);  // Initialize graph with number of points
@@ -106,30 +113,35 @@ ANN<datatype>::ANN(const std::vector<std::vector<datatype>>& points, const std::
     } 
 }
 
-template <typename datatype>
-ANN<datatype>::ANN(const std::vector<std::vector<datatype>>& points, const std::vector<float>& filters){
+template <typename datatype, typename Metric>
+ANN<datatype, Metric>::ANN(const std::vector<std::vector<datatype>>& points, const std::vector<float>& filters)
+    : ANN(std::vector<std::vector<datatype>>(points), filters){}
+
+template <typename datatype, typename Metric>
+ANN<datatype, Metric>::ANN(std::vector<std::vector<datatype>>&& points, const std::vector<float>& filters){
     if(points.size() != filters.size()){
         throw std::invalid_argument("ANN: Number of points and filters do not match");
     }
 
     // Init an empty graph with number of points
     this->G = new Graph(points.size(), true);
+    this->node_to_point_map = std::move(points);
+    this->normalizePoints();
 
-    for(std::size_t i = 0; i < points.size(); i++){
-        this->node_to_point_map.push_back(points[i]);
-        this->node_to_filter_map.push_back(filters[i]);
-        this->point_to_node_map[points[i]] = (int)i;
-        this->filter_to_node_map[filters[i]].push_back((int)i);
-    }
+    this->initLabels(filters);
 }
 
-template <typename datatype>
-void ANN<datatype>:: printGraph(){
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>:: printGraph(){
     this->G->printGraph();
 }
 
-template <typename datatype>
-ANN<datatype>::ANN(const std::vector<std::vector<datatype>>& points, const std::vector<std::unordered_set<int>>& edges, const std::vector<float>& filters){
+template <typename datatype, typename Metric>
+ANN<datatype, Metric>::ANN(const std::vector<std::vector<datatype>>& points, const std::vector<std::unordered_set<int>>& edges, const std::vector<float>& filters)
+    : ANN(std::vector<std::vector<datatype>>(points), edges, filters){}
+
+template <typename datatype, typename Metric>
+ANN<datatype, Metric>::ANN(std::vector<std::vector<datatype>>&& points, const std::vector<std::unordered_set<int>>& edges, const std::vector<float>& filters){
     if(points.size() != filters.size()){
         throw std::invalid_argument("ANN: Number of points and filters do not match");
     }
@@ -142,23 +154,291 @@ ANN<datatype>::ANN(const std::vector<std::vector<datatype>>& points, const std::
         this->G = new Graph(edges);
     }
 
-    for(std::size_t i = 0; i < points.size(); i++){
-        this->node_to_point_map.push_back(points[i]);
-        this->node_to_filter_map.push_back(filters[i]);
-        this->point_to_node_map[points[i]] = (int)i;
-        this->filter_to_node_map[filters[i]].push_back((int)i);
+    this->node_to_point_map = std::move(points);
+    this->normalizePoints();
+    this->initLabels(filters);
+}
+
+// Every node has exactly one filter value
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::initLabels(const std::vector<float>& filters){
+    std::vector<int> offsets(filters.size() + 1);
+    std::iota(offsets.begin(), offsets.end(), 0);
+    this->initLabels(filters, offsets);
+}
+
+// Map the filter values to dense label ids and group the nodes of every label together.
+// The filter values of node i are filters[offsets[i]..offsets[i+1]).
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::initLabels(const std::vector<float>& filters, const std::vector<int>& offsets){
+    std::size_t n = offsets.size() - 1;
+    this->node_label_offsets.assign(n + 1, 0);
+    this->node_label_ids.clear();
+    this->node_label_ids.reserve(filters.size());
+    this->node_label_signature.assign(n, 0);
+    this->node_to_label.assign(n, UNKNOWN_LABEL);
+    this->shared_labels = false;
+
+    for(std::size_t i = 0; i < n; i++){
+        std::size_t first = this->node_label_ids.size();
+        for(int j = offsets[i]; j < offsets[i + 1]; j++){
+            auto it = this->label_ids.find(filters[j]);
+            if(it == this->label_ids.end()){
+                it = this->label_ids.emplace(filters[j], (uint32_t)this->label_values.size()).first;
+                this->label_values.push_back(filters[j]);
+            }
+            this->node_label_ids.push_back(it->second);
+        }
+
+        // Keep the labels of the node sorted and unique
+        auto begin = this->node_label_ids.begin() + first;
+        std::sort(begin, this->node_label_ids.end());
+        this->node_label_ids.erase(std::unique(begin, this->node_label_ids.end()), this->node_label_ids.end());
+        this->node_label_offsets[i + 1] = (int)this->node_label_ids.size();
+
+        for(std::size_t j = first; j < this->node_label_ids.size(); j++){
+            this->node_label_signature[i] |= uint64_t(1) << (this->node_label_ids[j] & 63);
+        }
+
+        if(this->node_label_ids.size() > first)
+            this->node_to_label[i] = this->node_label_ids[first];
+        if(this->node_label_ids.size() > first + 1)
+            this->shared_labels = true;
+    }
+
+    // Count the nodes of every label and then place them with a counting sort
+    std::size_t num_labels = this->label_values.size();
+    this->label_offsets.assign(num_labels + 1, 0);
+    for(uint32_t label : this->node_label_ids){
+        this->label_offsets[label + 1]++;
+    }
+
+    for(std::size_t l = 0; l < num_labels; l++){
+        this->label_offsets[l + 1] += this->label_offsets[l];
+    }
+
+    std::vector<int> position(this->label_offsets.begin(), this->label_offsets.end() - 1);
+    this->label_nodes.resize(this->node_label_ids.size());
+    for(std::size_t i = 0; i < n; i++){
+        for(int j = this->node_label_offsets[i]; j < this->node_label_offsets[i + 1]; j++){
+            this->label_nodes[position[this->node_label_ids[j]]++] = (int)i;
+        }
+    }
+}
+
+template <typename datatype, typename Metric>
+bool ANN<datatype, Metric>::hasLabel(int node, uint32_t label){
+    if(!this->shared_labels)
+        return this->node_to_label[node] == label;
+
+    if(((this->node_label_signature[node] >> (label & 63)) & 1) == 0)
+        return false;
+
+    const uint32_t* first = this->node_label_ids.data() + this->node_label_offsets[node];
+    const uint32_t* last = this->node_label_ids.data() + this->node_label_offsets[node + 1];
+    return std::binary_search(first, last, label);
+}
+
+// Check if two nodes have a common label
+template <typename datatype, typename Metric>
+bool ANN<datatype, Metric>::shareLabel(int a, int b){
+    if(!this->shared_labels)
+        return this->node_to_label[a] == this->node_to_label[b] && this->node_to_label[a] != UNKNOWN_LABEL;
+
+    if((this->node_label_signature[a] & this->node_label_signature[b]) == 0)
+        return false;
+
+    int i = this->node_label_offsets[a];
+    int j = this->node_label_offsets[b];
+    while(i < this->node_label_offsets[a + 1] && j < this->node_label_offsets[b + 1]){
+        if(this->node_label_ids[i] == this->node_label_ids[j])
+            return true;
+
+        if(this->node_label_ids[i] < this->node_label_ids[j])
+            i++;
+        else
+            j++;
+    }
+
+    return false;
+}
+
+// Filtered robustPrune can remove the edge point -> element because of closest only if every label
+// that point and element have in common is a label of closest too
+template <typename datatype, typename Metric>
+bool ANN<datatype, Metric>::labelsCovered(int point, int element, int closest){
+    if(!this->shared_labels)
+        return this->node_to_label[point] != this->node_to_label[element] || this->node_to_label[closest] == this->node_to_label[point];
+
+    uint64_t common = this->node_label_signature[point] & this->node_label_signature[element];
+    if(common == 0)
+        return true;
+
+    int i = this->node_label_offsets[point];
+    int j = this->node_label_offsets[element];
+    while(i < this->node_label_offsets[point + 1] && j < this->node_label_offsets[element + 1]){
+        uint32_t label_i = this->node_label_ids[i];
+        uint32_t label_j = this->node_label_ids[j];
+        if(label_i == label_j){
+            if(!this->hasLabel(closest, label_i))
+                return false;
+            i++;
+            j++;
+        }
+        else if(label_i < label_j)
+            i++;
+        else
+            j++;
+    }
+
+    return true;
+}
+
+// The signature rejects most of the nodes before the label lists are checked
+template <typename datatype, typename Metric>
+bool ANN<datatype, Metric>::matchesPredicate(int node, const LabelPredicate& predicate){
+    uint64_t common = this->node_label_signature[node] & predicate.signature;
+    if(predicate.match_all){
+        if(common != predicate.signature)
+            return false;
+
+        for(uint32_t label : predicate.labels){
+            if(!this->hasLabel(node, label))
+                return false;
+        }
+        return true;
+    }
+
+    if(common == 0)
+        return false;
+
+    for(uint32_t label : predicate.labels){
+        if(this->hasLabel(node, label))
+            return true;
+    }
+    return false;
+}
+
+// Filter values that no point has are ignored by "any of" predicates and match nothing in "all of" predicates
+template <typename datatype, typename Metric>
+LabelPredicate ANN<datatype, Metric>::makePredicate(const std::vector<float>& filters, bool match_all){
+    LabelPredicate predicate{{}, 0, match_all};
+    for(float filter : filters){
+        uint32_t label = this->labelId(filter);
+        if(label == UNKNOWN_LABEL){
+            if(match_all){
+                predicate.labels.clear();
+                predicate.signature = 0;
+                return predicate;
+            }
+            continue;
+        }
+
+        predicate.labels.push_back(label);
+        predicate.signature |= uint64_t(1) << (label & 63);
+    }
+
+    std::sort(predicate.labels.begin(), predicate.labels.end());
+    predicate.labels.erase(std::unique(predicate.labels.begin(), predicate.labels.end()), predicate.labels.end());
+    return predicate;
+}
+
+// Label id of a filter value or UNKNOWN_LABEL if no point has it
+template <typename datatype, typename Metric>
+uint32_t ANN<datatype, Metric>::labelId(float filter){
+    auto it = this->label_ids.find(filter);
+    return it == this->label_ids.end() ? UNKNOWN_LABEL : it->second;
+}
+
+template <typename datatype, typename Metric>
+std::vector<int> ANN<datatype, Metric>::labelNodes(uint32_t label){
+    return std::vector<int>(this->label_nodes.begin() + this->label_offsets[label], this->label_nodes.begin() + this->label_offsets[label + 1]);
+}
+
+// Constructor for points with any number of filter values
+template <typename datatype, typename Metric>
+ANN<datatype, Metric>::ANN(const std::vector<std::vector<datatype>>& points, const std::vector<std::vector<float>>& filter_sets)
+    : ANN(std::vector<std::vector<datatype>>(points), filter_sets){}
+
+template <typename datatype, typename Metric>
+ANN<datatype, Metric>::ANN(std::vector<std::vector<datatype>>&& points, const std::vector<std::vector<float>>& filter_sets){
+    if(points.size() != filter_sets.size()){
+        throw std::invalid_argument("ANN: Number of points and filters do not match");
+    }
+
+    // Init an empty graph with number of points
+    this->G = new Graph(points.size(), true);
+    this->node_to_point_map = std::move(points);
+    this->normalizePoints();
+
+    std::vector<float> filters;
+    std::vector<int> offsets(1, 0);
+    for(const auto& filter_set : filter_sets){
+        filters.insert(filters.end(), filter_set.begin(), filter_set.end());
+        offsets.push_back((int)filters.size());
+    }
+
+    this->initLabels(filters, offsets);
+}
+
+template <typename datatype, typename Metric>
+ANN<datatype, Metric>::ANN(const std::vector<std::vector<datatype>>& points, const std::vector<float>& filters, const std::vector<float>& timestamps)
+    : ANN(std::vector<std::vector<datatype>>(points), filters, timestamps){}
+
+template <typename datatype, typename Metric>
+ANN<datatype, Metric>::ANN(std::vector<std::vector<datatype>>&& points, const std::vector<float>& filters, const std::vector<float>& timestamps)
+    : ANN(std::move(points), filters){
+    if(this->node_to_point_map.size() != timestamps.size()){
+        std::cerr   << "Error : Number of points and timestamps do not match" << RESET << std::endl;
+        throw std::invalid_argument("ANN: Number of points and timestamps do not match");
+    }
+
+    this->initTimestamps(timestamps);
+}
+
+// Sort the nodes by timestamp, so that the nodes in a range can be found with binary search
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::initTimestamps(const std::vector<float>& timestamps){
+    this->node_to_timestamp = timestamps;
+
+    auto earlier = [this](int a, int b){
+        return this->node_to_timestamp[a] < this->node_to_timestamp[b];
+    };
+
+    this->timestamp_order.resize(timestamps.size());
+    std::iota(this->timestamp_order.begin(), this->timestamp_order.end(), 0);
+    std::stable_sort(this->timestamp_order.begin(), this->timestamp_order.end(), earlier);
+
+    for(std::size_t l = 0; l + 1 < this->label_offsets.size(); l++){
+        std::stable_sort(this->label_nodes.begin() + this->label_offsets[l], this->label_nodes.begin() + this->label_offsets[l + 1], earlier);
+    }
+}
+
+// Nodes with timestamp in [low, high]. If label is UNKNOWN_LABEL all the nodes are checked.
+template <typename datatype, typename Metric>
+std::pair<const int*, const int*> ANN<datatype, Metric>::rangeNodes(uint32_t label, float low, float high){
+    const int* first = this->timestamp_order.data();
+    const int* last = first + this->timestamp_order.size();
+    if(label != UNKNOWN_LABEL){
+        first = this->label_nodes.data() + this->label_offsets[label];
+        last = this->label_nodes.data() + this->label_offsets[label + 1];
     }
+
+    const std::vector<float>& timestamps = this->node_to_timestamp;
+    first = std::lower_bound(first, last, low, [&timestamps](int node, float value){ return timestamps[node] < value; });
+    last = std::upper_bound(first, last, high, [&timestamps](float value, int node){ return value < timestamps[node]; });
+    return std::make_pair(first, last);
 }
 
-template <typename datatype>
-ANN<datatype>::~ANN(){
+template <typename datatype, typename Metric>
+ANN<datatype, Metric>::~ANN(){
     if(this->G != nullptr)
         delete this->G;
 }
 
 
-template<typename datatype>
-bool ANN<datatype>::checkErrorsGreedy(const int& start, int k, int upper_limit){
+template<typename datatype, typename Metric>
+bool ANN<datatype, Metric>::checkErrorsGreedy(const int& start, int k, int upper_limit){
     if(this->node_to_point_map.empty()){
         std::cerr   << "Error : Graph is empty" << RESET << std::endl;
         throw std::invalid_argument("greedySearch: Graph is empty");
@@ -181,8 +461,8 @@ bool ANN<datatype>::checkErrorsGreedy(const int& start, int k, int upper_limit){
     return false;
 }
 
-template <typename datatype>
-bool ANN<datatype>::checkErrorsRobust(const int & point, const float alpha, const int degree_bound){
+template <typename datatype, typename Metric>
+bool ANN<datatype, Metric>::checkErrorsRobust(const int & point, const float alpha, const int degree_bound){
 
     if(this->node_to_point_map.empty()){
         std::cerr   << "Error : Graph is empty" << RESET << std::endl;
@@ -212,29 +492,55 @@ bool ANN<datatype>::checkErrorsRobust(const int & point, const float alpha, cons
     return false;
 }
 
-template <typename datatype>
-bool ANN<datatype>::checkGraph(std::vector<std::unordered_set<int>> edges){
+template <typename datatype, typename Metric>
+bool ANN<datatype, Metric>::checkGraph(std::vector<std::unordered_set<int>> edges){
     return this->G->checkSimilarity(edges);
 }
 
 // Check if a has an outgoing edge to b
-template <typename datatype>
-bool ANN<datatype>::checkNeighbour(int a, int b){
+template <typename datatype, typename Metric>
+bool ANN<datatype, Metric>::checkNeighbour(int a, int b){
     return this->G->isNeighbour(a,b);
 }
 
 // Fill the filter_to_start_node map for testing
-template <typename datatype>
-void ANN<datatype>::fillFilterToStartNode(std::unordered_map<float, int>& filter_to_start_node){
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::fillFilterToStartNode(std::unordered_map<float, int>& filter_to_start_node){
+    this->label_start_node.resize(this->label_values.size(), -1);
     for(const auto& pair : filter_to_start_node){
-        this->filter_to_start_node[pair.first] = pair.second;
+        uint32_t label = this->labelId(pair.first);
+        if(label != UNKNOWN_LABEL)
+            this->label_start_node[label] = pair.second;
+    }
+
+    // One start point per label
+    this->label_start_offsets.assign(1, 0);
+    this->label_starts.clear();
+    for(int start : this->label_start_node){
+        if(start != -1)
+            this->label_starts.push_back(start);
+        this->label_start_offsets.push_back((int)this->label_starts.size());
     }
 }
 
 // Filtered Greedy Search algorithm to find the nearest neighbours with a filter value
-template <typename datatype>
-template <typename Compare>
-void ANN<datatype>::filteredGreedySearch(const int& start_node, int k, int upper_limit, const float& filter_query_value, std::set<int, Compare>& NNS, std::unordered_set<int>& Visited, CompareVectors<datatype>& compare){
+template <typename datatype, typename Metric>
+template <typename Compare, typename Allocator>
+void ANN<datatype, Metric>::filteredGreedySearch(const int& start_node, int k, int upper_limit, const float& filter_query_value, std::set<int, Compare, Allocator>& NNS, VisitedSet<Allocator>& Visited, CompareVectors<datatype, Metric>& compare, [[maybe_unused]] SearchStats* stats){
+    STATS_ONLY(auto stats_start = std::chrono::steady_clock::now();
+               std::size_t stats_distances = search_distance_count;)
+
+    // Translate the filter value once, so that the search compares only label ids
+    uint32_t label = start_node == -1 ? UNKNOWN_LABEL : this->labelId(filter_query_value);
+    this->labelGreedySearch(start_node, k, upper_limit, label, NNS, Visited, compare, stats);
+
+    STATS_ONLY(finishSearchStats(stats, stats_start, search_distance_count - stats_distances, Visited.size());)
+}
+
+// Filtered Greedy Search with the label id of the filter
+template <typename datatype, typename Metric>
+template <typename Compare, typename Allocator>
+void ANN<datatype, Metric>::labelGreedySearch(const int& start_node, int k, int upper_limit, uint32_t label, std::set<int, Compare, Allocator>& NNS, VisitedSet<Allocator>& Visited, CompareVectors<datatype, Metric>& compare, [[maybe_unused]] SearchStats* stats){
     // Error handling
     if(this->checkErrorsGreedy(start_node, k, upper_limit)){
         NNS.clear();
@@ -244,18 +550,22 @@ void ANN<datatype>::filteredGreedySearch(const int& start_node, int k, int upper
     // If the start_node has value -1, then this means we are checking for a unfiltered query.
     // In this case, we are performing a "quick" filtered greedy search to find the nearest node in every sub graph.
     //Possible Paralllelization Section
-    std::set<int, Compare> difference(compare);
+    std::set<int, Compare, Allocator> difference(compare, NNS.get_allocator());
     if(start_node == -1){
-        std::set<int, Compare> temp_nns(compare);
-        std::unordered_set<int> temp_visited;
+        std::set<int, Compare, Allocator> temp_nns(compare, NNS.get_allocator());
+        VisitedSet<Allocator> temp_visited(NNS.get_allocator());
         int temp_upper_limit = upper_limit < 2 ? upper_limit : 2;
         
         //Possible Paralllelization Section
-        for(const auto& pair : this->filter_to_start_node){
+        for(uint32_t l = 0; l < this->label_start_node.size(); l++){
+            int label_start = this->label_start_node[l];
+            if(label_start == -1)
+                continue;
+
             temp_nns.clear();
             temp_visited.clear();
-            temp_nns.insert(pair.second);
-            this->filteredGreedySearch(pair.second, 1, temp_upper_limit, pair.first, temp_nns, temp_visited, compare);
+            temp_nns.insert(label_start);
+            this->labelGreedySearch(label_start, 1, temp_upper_limit, l, temp_nns, temp_visited, compare, stats);
 
             // Insert the node that greedy found to NNS and difference
             NNS.insert(*(temp_nns.begin()));
@@ -265,6 +575,14 @@ void ANN<datatype>::filteredGreedySearch(const int& start_node, int k, int upper
     else{
         // If the start_node is not -1, then NNS contains the start_node already
         difference.insert(start_node);
+
+        // The other start points of the label are spread over its nodes, so they shorten the search
+        if(label != UNKNOWN_LABEL && label + 1 < this->label_start_offsets.size()){
+            for(int j = this->label_start_offsets[label]; j < this->label_start_offsets[label + 1]; j++){
+                NNS.insert(this->label_starts[j]);
+                difference.insert(this->label_starts[j]);
+            }
+        }
     } 
 
     std::vector<int> neighbours;
@@ -276,21 +594,18 @@ void ANN<datatype>::filteredGreedySearch(const int& start_node, int k, int upper
 
         // Add the closest point to the Visited set
         Visited.insert(closest_point);
+        STATS_ONLY(if(stats) stats->expansions++;)
 
-        // Get the neighbors of the closest point
+        // Get the neighbors of the closest point, without the visited ones and the ones of other labels
         neighbours.clear();
         this->neighbourNodes(closest_point, neighbours);
+        neighbours.erase(std::remove_if(neighbours.begin(), neighbours.end(), [&](int neighbour){
+            return Visited.find(neighbour) != Visited.end() || (start_node != -1 && !this->hasLabel(neighbour, label));
+        }), neighbours.end());
 
-        // Possible Parallelization Section
+        // Distances of all the new neighbours at once, then the sets find them in the shared distance map
+        compare.computeDistances(neighbours);
         for(const int& neighbour : neighbours){
-            // Skip if the neighbour has already been visited
-            if(Visited.find(neighbour) != Visited.end())
-                continue;
-            
-            // Filtered query handle
-            if(start_node != -1 && this->node_to_filter_map[neighbour] != filter_query_value)
-                continue;
-            
             NNS.insert(neighbour);
             difference.insert(neighbour);
         }
@@ -299,6 +614,7 @@ void ANN<datatype>::filteredGreedySearch(const int& start_node, int k, int upper
         // Prune NNS to retain upper_limit closest points
         if(NNS.size() > (std::size_t)upper_limit){
             this->pruneSet(NNS, difference, upper_limit);
+            STATS_ONLY(if(stats) stats->prunes++;)
         }
     }
 
@@ -308,18 +624,21 @@ void ANN<datatype>::filteredGreedySearch(const int& start_node, int k, int upper
 }
 
 // Greedy search algorithm to find the nearest neighbours
-template <typename datatype>
-template <typename Compare>
-void ANN<datatype>::greedySearch(const int& start, int k, int upper_limit, std::set<int, Compare>& NNS, std::unordered_set<int>& Visited, CompareVectors<datatype>& compare){
+template <typename datatype, typename Metric>
+template <typename Compare, typename Allocator>
+void ANN<datatype, Metric>::greedySearch(const int& start, int k, int upper_limit, std::set<int, Compare, Allocator>& NNS, VisitedSet<Allocator>& Visited, CompareVectors<datatype, Metric>& compare, [[maybe_unused]] SearchStats* stats){
     // Error handling
     if(this->checkErrorsGreedy(start, k, upper_limit)){
         NNS.clear();
         return;
     }
 
+    STATS_ONLY(auto stats_start = std::chrono::steady_clock::now();
+               std::size_t stats_distances = search_distance_count;)
+
     //Possible Paralllelization Section
     // difference set the first time will have the start node
-    std::set<int, CompareVectors<datatype>> difference(compare);
+    std::set<int, Compare, Allocator> difference(compare, NNS.get_allocator());
     difference.insert(start);
 
     // Neighbour vector to use inside the loop
@@ -329,13 +648,15 @@ void ANN<datatype>::greedySearch(const int& start, int k, int upper_limit, std::
 
         // Get the index of the closest point
         int closest_point = *(difference.begin());
+        STATS_ONLY(if(stats) stats->expansions++;)
  
         // Get the neighbors of the closest point
         this->neighbourNodes(closest_point, neighbours);
 
-        // TODO Change Structure of for Loop to be like filteredGreedySearch
+        // Distances of all the neighbours at once, then the sets find them in the shared distance map
+        compare.computeDistances(neighbours);
+
         // Update NNS set with neighbours of closest_point
-        //Possible Paralllelization Section
         for(const auto& neighbour : neighbours){
             NNS.insert(neighbour);
             
@@ -353,205 +674,798 @@ void ANN<datatype>::greedySearch(const int& start, int k, int upper_limit, std::
         // Update NNS to retain upper_limit closest points and update difference set
         if(NNS.size() > static_cast<std::size_t>(upper_limit)){
             this->pruneSet(NNS, difference, upper_limit);
+            STATS_ONLY(if(stats) stats->prunes++;)
         }
     }
 
     // Return k closest points to Xq, using regular set
     this->pruneSet(NNS, difference, k);
+
+    STATS_ONLY(finishSearchStats(stats, stats_start, search_distance_count - stats_distances, Visited.size());)
 }
 
-template <typename datatype>
+template <typename datatype, typename Metric>
 template <typename Compare>
-void ANN<datatype>::robustPrune(const int &point, std::set<int, Compare>& candidate_set, const float alpha, const int degree_bound, bool filtered){
-     // Error handling
-    if(this->checkErrorsRobust(point, alpha, degree_bound))
+void ANN<datatype, Metric>::batchGreedySearch(const int& start, int k, int upper_limit, std::vector<std::set<int, Compare>>& NNS, std::vector<std::unordered_set<int>>& Visited, std::vector<CompareVectors<datatype, Metric>>& compares){
+    std::size_t batch = compares.size();
+    if(NNS.size() != batch || Visited.size() != batch){
+        std::cerr << "Error : Batch has " << batch << " queries, " << NNS.size() << " result sets and " << Visited.size() << " visited sets" << RESET << std::endl;
+        throw std::invalid_argument("batchGreedySearch: Sizes of the batch do not match");
+    }
+
+    if(this->checkErrorsGreedy(start, k, upper_limit)){
+        for(auto& result : NNS){
+            result.clear();
+        }
         return;
-    
-    std::vector<int> neighbours;
-    this->neighbourNodes(point, neighbours);
+    }
 
-    for(const auto& neighbour : neighbours){
-        candidate_set.insert(neighbour);
+    // The state of a search between its steps, the candidates and the node it expands next with its neighbours
+    struct Search{
+        std::set<int, Compare> difference;
+        std::vector<int> neighbours;
+        int closest_point = -1;
+
+        Search(const Compare& compare) : difference(compare){}
+    };
+
+    // Choose the next node of a search and prefetch the headers of the vectors of its neighbours, then the search yields.
+    // The vectors are prefetched one turn before the search computes them, when their headers are loaded.
+    auto prepare = [this, &compares](Search& search, std::size_t i){
+        search.closest_point = *(search.difference.begin());
+        this->neighbourNodes(search.closest_point, search.neighbours);
+        compares[i].prefetchHeaders(search.neighbours);
+    };
+
+    std::vector<Search> searches;
+    searches.reserve(batch);
+    std::vector<std::size_t> active;
+    for(std::size_t i = 0; i < batch; i++){
+        searches.emplace_back(compares[i]);
+        searches[i].difference.insert(start);
+        prepare(searches[i], i);
+        active.push_back(i);
     }
 
-    // Remove point p from candidate_set and prune all its neighbours
-    candidate_set.erase(point);
-    this->G->removeNeighbours(point);
+    // Every round does one expansion of every active search, the same steps as an iteration of greedySearch
+    while(!active.empty()){
+        compares[active[0]].prefetchVectors(searches[active[0]].neighbours);
+        for(std::size_t j = 0; j < active.size();){
+            std::size_t i = active[j];
+            Search& search = searches[i];
 
-    while(true){
+            if(j + 1 < active.size())
+                compares[active[j + 1]].prefetchVectors(searches[active[j + 1]].neighbours);
 
-        if(candidate_set.size() == 0)
-            break;
+            compares[i].computeDistances(search.neighbours);
+            for(const auto& neighbour : search.neighbours){
+                NNS[i].insert(neighbour);
 
-        int closest_point = *(candidate_set.begin());
+                if(Visited[i].find(neighbour) == Visited[i].end())
+                    search.difference.insert(neighbour);
+            }
+            search.neighbours.clear();
 
-        // Closest point would have been removed from candidate set in alpha comparison step anyway
-        candidate_set.erase(closest_point);
-        this->G->addEdge(point, closest_point);
-        if(this->G->countNeighbours(point) == degree_bound)
-            break;
+            Visited[i].insert(search.closest_point);
+            search.difference.erase(search.closest_point);
 
-        // Parallelization Section
-        for(auto it = candidate_set.begin(); it != candidate_set.end();){
-            const auto& element = *it;
-           
-            if(filtered == FILTERED){
-                if(!((this->node_to_filter_map[element] == this->node_to_filter_map[closest_point] &&
-                    this->node_to_filter_map[element] == this->node_to_filter_map[point]) || this->node_to_filter_map[element] != this->node_to_filter_map[point])){
-                    it++;
-                    continue;
-                }
-            }
-            auto x = this->node_to_point_map[closest_point];
-            auto y = this->node_to_point_map[element];
-            auto z = this->node_to_point_map[point];
-            std::size_t dim = y.size();
+            if(NNS[i].size() > static_cast<std::size_t>(upper_limit))
+                this->pruneSet(NNS[i], search.difference, upper_limit);
 
-            if(alpha * float(calculateDistance(x, y, dim)) <= float(calculateDistance(y, z, dim))){
-                it = candidate_set.erase(it);
-            }
-            else{
-                it++;
+            if(search.difference.empty()){
+                // The order is kept, so the next search is the one whose vectors were prefetched
+                this->pruneSet(NNS[i], search.difference, k);
+                active.erase(active.begin() + j);
+                continue;
             }
+
+            prepare(search, i);
+            j++;
         }
     }
 }
 
-template <typename datatype>
-bool ANN<datatype>::checkFilteredFindMedoid(std::size_t num_of_filters){
-    if(this->filter_to_start_node.size() != num_of_filters){
-        throw std::invalid_argument("filteredFindMedoid: Filter map size does not match the number of filters");
-        return false;
+// Greedy search through the nodes for which navigate is true, that keeps in NNS only the nodes for which
+// accept is true. The list of candidates has search_limit nodes and NNS has upper_limit nodes.
+template <typename datatype, typename Metric>
+template <typename Compare, typename Navigate, typename Accept>
+void ANN<datatype, Metric>::subgraphSearch(const std::vector<int>& seeds, int k, int upper_limit, int search_limit, Navigate navigate, Accept accept, std::set<int, Compare>& NNS, std::unordered_set<int>& Visited, CompareVectors<datatype, Metric>& compare){
+    std::set<int, Compare> candidates(compare);
+    std::set<int, Compare> difference(compare);
+    for(int seed : seeds){
+        candidates.insert(seed);
+        difference.insert(seed);
+        if(accept(seed))
+            NNS.insert(seed);
     }
 
-    return true;
-}
+    std::vector<int> neighbours;
+    while(!difference.empty()){
+        int closest_point = *(difference.begin());
+        difference.erase(closest_point);
+        Visited.insert(closest_point);
 
-template <typename datatype>
-int ANN<datatype>::getStartNode(float filter){
-    if(this->filter_to_start_node.empty()){
-        this->filteredFindMedoid();
-    }
+        neighbours.clear();
+        this->neighbourNodes(closest_point, neighbours);
+        neighbours.erase(std::remove_if(neighbours.begin(), neighbours.end(), [&](int neighbour){
+            return Visited.find(neighbour) != Visited.end() || !navigate(neighbour);
+        }), neighbours.end());
 
-    auto it = this->filter_to_start_node.find(filter);
-    if(it == this->filter_to_start_node.end()){
-        return -1;
-    }
+        compare.computeDistances(neighbours);
+        for(const int& neighbour : neighbours){
+            candidates.insert(neighbour);
+            difference.insert(neighbour);
+            if(accept(neighbour))
+                NNS.insert(neighbour);
+        }
 
-    return it->second;
-}
+        if(candidates.size() > (std::size_t)search_limit){
+            this->pruneSet(candidates, difference, search_limit);
+        }
 
-template <typename datatype>
-void ANN<datatype>::filteredFindMedoid(){
-    if(this->node_to_filter_map.empty()){
-        throw std::invalid_argument("filteredFindMedoid: Filter map is empty");
-        return;
+        while(NNS.size() > (std::size_t)upper_limit){
+            NNS.erase(std::prev(NNS.end()));
+        }
     }
-    
-    // Init a rng
-    std::mt19937 rng(std::chrono::steady_clock::now().time_since_epoch().count());
-
-    for(const auto& pair : this->filter_to_node_map){
-        const float& filter = pair.first;
-        const std::vector<int>& Pf = pair.second;
 
-        // Pick a random node from Pf to be the start node for the filter 
-        std::size_t index = rng() % Pf.size();
-        this->filter_to_start_node[filter] = Pf[index];
+    while(NNS.size() > (std::size_t)k){
+        NNS.erase(std::prev(NNS.end()));
     }
 }
 
-template <typename datatype>
-void ANN<datatype>::calculateMedoid(){
-    std::size_t n = this->node_to_point_map.size();
-    if(n == 0){
-        std::cerr   << "Error : No points in the dataset" << RESET << std::endl;
-        throw std::invalid_argument("calculateMedoid: No points in the dataset");
+// Greedy search that returns only nodes with timestamp in [low, high] and with the filter value if it is not -1.
+// If few nodes are in the range, they are all compared with the query. Otherwise the graph is searched
+// through all the nodes (of the filter) and only the nodes in the range are kept. Because only a part
+// of the visited nodes is in the range, the search list grows to upper_limit divided by the selectivity.
+// If the start_node is -1, the search starts from the start node of every filter.
+template <typename datatype, typename Metric>
+template <typename Compare>
+void ANN<datatype, Metric>::rangeGreedySearch(const int& start_node, int k, int upper_limit, const float& filter, float low, float high, std::set<int, Compare>& NNS, std::unordered_set<int>& Visited, CompareVectors<datatype, Metric>& compare){
+    // Error handling
+    if(this->checkErrorsGreedy(start_node, k, upper_limit)){
+        NNS.clear();
         return;
     }
 
-    // Hold the sum of distances for each point
-    std::vector<float> sum_distances(n, 0.0);
+    if(this->node_to_timestamp.size() != this->node_to_point_map.size()){
+        std::cerr   << "Error : Points don't have timestamps" << RESET << std::endl;
+        throw std::invalid_argument("rangeGreedySearch: Points don't have timestamps");
+    }
 
-    std::size_t dim = 0;
-    if(this->node_to_point_map.size() > 0)
-        dim = this->node_to_point_map[0].size();
-    else
-        throw std::invalid_argument("calculateMedoid: No points in the dataset");
+    NNS.clear();
 
-    #if defined(PARALLEL2)
-        std::vector<float> local_sums(n, 0.0);
-        
-        #pragma omp for schedule(static) nowait
-        for(std::size_t i = 0; i < n; i++) {
-            for(std::size_t j = i + 1; j < n; j++) {
-                float distance = calculateDistance(this->node_to_point_map[i], 
-                                                this->node_to_point_map[j], dim);
-                local_sums[i] += distance;
-                local_sums[j] += distance;
-            }
-        }
+    uint32_t label = UNKNOWN_LABEL;
+    std::size_t total = this->node_to_point_map.size();
+    if(filter != -1){
+        label = this->labelId(filter);
+        if(label == UNKNOWN_LABEL)
+            return;
 
-        #pragma omp critical
-        for(std::size_t i = 0; i < n; i++) {
-            sum_distances[i] += local_sums[i];
+        total = this->label_offsets[label + 1] - this->label_offsets[label];
+    }
+
+    auto [first, last] = this->rangeNodes(label, low, high);
+    std::size_t count = last - first;
+    if(count == 0)
+        return;
+
+    // The search list grows to upper_limit / selectivity nodes and the neighbours of every node in it are compared,
+    // so scanning the range is cheaper up to a few times the size of the list
+    double search_limit = (double)upper_limit * total / count;
+    if((double)count <= 4 * search_limit){
+        for(const int* node = first; node != last; node++){
+            NNS.insert(*node);
+            if(NNS.size() > (std::size_t)k)
+                NNS.erase(std::prev(NNS.end()));
         }
-    #else
-        // Serial Approach
-        // Calculate one time the distance between each pair of points to save time
-        for(std::size_t i = 0; i < n; i++){
-            for(std::size_t j = i + 1; j < n; j++){
-                float distance = calculateDistance(this->node_to_point_map[i], this->node_to_point_map[j], dim);
-                sum_distances[i] += distance;
-                sum_distances[j] += distance;
-            }
+        return;
+    }
+
+    std::vector<int> seeds;
+    if(start_node != -1){
+        seeds.push_back(start_node);
+    }
+    else if(label != UNKNOWN_LABEL){
+        seeds.assign(this->label_starts.begin() + this->label_start_offsets[label], this->label_starts.begin() + this->label_start_offsets[label + 1]);
+    }
+    else{
+        for(int label_start : this->label_start_node){
+            if(label_start != -1)
+                seeds.push_back(label_start);
         }
-    #endif
+    }
 
-    // Find the point with the minimum sum of distances
-    auto min_iterator = std::min_element(sum_distances.begin(), sum_distances.end());
-    std::size_t index_min = std::distance(sum_distances.begin(), min_iterator);
-    this->cached_medoid = index_min;
+    auto navigate = [&](int node){
+        return label == UNKNOWN_LABEL || this->hasLabel(node, label);
+    };
+    auto in_range = [&](int node){
+        return this->node_to_timestamp[node] >= low && this->node_to_timestamp[node] <= high;
+    };
+
+    this->subgraphSearch(seeds, k, upper_limit, (int)search_limit, navigate, in_range, NNS, Visited, compare);
 }
 
-template <typename datatype>
-void ANN<datatype>::randomMedoid(){
-    std::size_t n = this->node_to_point_map.size();
-    if(n == 0){
-        std::cerr << "Error : No points in the dataset" << RESET << std::endl;
-        throw std::invalid_argument("randomMedoid: No points in the dataset");
+// Greedy search for the points that have all (MATCH_ALL) or any (MATCH_ANY) of the filter values.
+// "Any of" searches the sub-graphs of all the labels starting from the start node of each one.
+// "All of" searches the sub-graph of the rarest label and keeps only the nodes with all the labels,
+// or compares all of them with the query if there are few.
+template <typename datatype, typename Metric>
+template <typename Compare>
+void ANN<datatype, Metric>::labelSetGreedySearch(int k, int upper_limit, const std::vector<float>& filters, bool match_all, std::set<int, Compare>& NNS, std::unordered_set<int>& Visited, CompareVectors<datatype, Metric>& compare){
+    // Error handling
+    if(this->checkErrorsGreedy(-1, k, upper_limit)){
+        NNS.clear();
         return;
     }
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<std::size_t> dis(0, n-1);
+    if(this->label_start_node.empty()){
+        this->filteredFindMedoid();
+    }
 
-    this->cached_medoid = dis(gen);
-}
+    NNS.clear();
 
-template <typename datatype>
-const int& ANN<datatype>::getMedoid(){
-    if(!this->cached_medoid.has_value())
-        this->calculateMedoid();
+    LabelPredicate predicate = this->makePredicate(filters, match_all);
+    if(predicate.labels.empty())
+        return;
 
-    return this->cached_medoid.value();
-}
+    auto matches = [&](int node){
+        return this->matchesPredicate(node, predicate);
+    };
 
-template <typename datatype>
-void ANN<datatype>::Vamana(float alpha, int L, int R){
-    
-    this->G->enforceRegular(R);
+    if(match_all == MATCH_ANY){
+        std::vector<int> seeds;
+        for(uint32_t label : predicate.labels){
+            seeds.insert(seeds.end(), this->label_starts.begin() + this->label_start_offsets[label], this->label_starts.begin() + this->label_start_offsets[label + 1]);
+        }
 
-    // Calculate medoid of dataset
-    #if defined(OPTIMIZED)
-        this->randomMedoid();
-    #else
-        this->calculateMedoid();
-    #endif
+        this->subgraphSearch(seeds, k, upper_limit, upper_limit, matches, matches, NNS, Visited, compare);
+        return;
+    }
 
-    // Get a random permutation of 1 to n
-    std::vector<int> perm;
+    uint32_t rarest = predicate.labels[0];
+    for(uint32_t label : predicate.labels){
+        if(this->label_offsets[label + 1] - this->label_offsets[label] < this->label_offsets[rarest + 1] - this->label_offsets[rarest])
+            rarest = label;
+    }
+
+    std::vector<int> matching;
+    for(int j = this->label_offsets[rarest]; j < this->label_offsets[rarest + 1]; j++){
+        if(matches(this->label_nodes[j]))
+            matching.push_back(this->label_nodes[j]);
+    }
+
+    if(matching.empty())
+        return;
+
+    // Same choice as rangeGreedySearch, the matching nodes are a part of the rarest label
+    std::size_t total = this->label_offsets[rarest + 1] - this->label_offsets[rarest];
+    double search_limit = (double)upper_limit * total / matching.size();
+    if((double)matching.size() <= 4 * search_limit){
+        for(int node : matching){
+            NNS.insert(node);
+            if(NNS.size() > (std::size_t)k)
+                NNS.erase(std::prev(NNS.end()));
+        }
+        return;
+    }
+
+    auto navigate = [&](int node){
+        return this->hasLabel(node, rarest);
+    };
+
+    std::vector<int> seeds(this->label_starts.begin() + this->label_start_offsets[rarest], this->label_starts.begin() + this->label_start_offsets[rarest + 1]);
+    this->subgraphSearch(seeds, k, upper_limit, (int)search_limit, navigate, matches, NNS, Visited, compare);
+}
+
+template <typename datatype, typename Metric>
+template <typename Compare, typename Allocator>
+void ANN<datatype, Metric>::robustPrune(const int &point, std::set<int, Compare, Allocator>& candidate_set, const float alpha, const int degree_bound, bool filtered){
+     // Error handling
+    if(this->checkErrorsRobust(point, alpha, degree_bound))
+        return;
+
+    std::vector<int> selected;
+    this->selectNeighbours(point, candidate_set, alpha, degree_bound, filtered, selected);
+
+    // Replace the neighbours of point with the selected nodes
+    this->G->removeNeighbours(point);
+    for(int neighbour : selected){
+        this->G->addEdge(point, neighbour);
+    }
+}
+
+// The selection of robustPrune without changing the graph, so that it can run while other threads read it.
+// The current neighbours of point are candidates too.
+template <typename datatype, typename Metric>
+template <typename Compare, typename Allocator>
+void ANN<datatype, Metric>::selectNeighbours(const int& point, std::set<int, Compare, Allocator>& candidate_set, const float alpha, const int degree_bound, bool filtered, std::vector<int>& selected){
+    std::vector<int> neighbours;
+    this->neighbourNodes(point, neighbours);
+
+    for(const auto& neighbour : neighbours){
+        candidate_set.insert(neighbour);
+    }
+
+    // Remove point p from candidate_set
+    candidate_set.erase(point);
+
+    selected.clear();
+    const auto& z = this->node_to_point_map[point];
+    std::size_t dim = z.size();
+    while(true){
+
+        if(candidate_set.size() == 0)
+            break;
+
+        int closest_point = *(candidate_set.begin());
+
+        // Closest point would have been removed from candidate set in alpha comparison step anyway
+        candidate_set.erase(closest_point);
+        selected.push_back(closest_point);
+        if((int)selected.size() == degree_bound)
+            break;
+
+        const auto& x = this->node_to_point_map[closest_point];
+
+        // Parallelization Section
+        for(auto it = candidate_set.begin(); it != candidate_set.end();){
+            const auto& element = *it;
+           
+            if(filtered == FILTERED && !this->labelsCovered(point, element, closest_point)){
+                it++;
+                continue;
+            }
+            const auto& y = this->node_to_point_map[element];
+
+            if(Metric::relax(alpha, metricDistance<Metric>(x, y, dim)) <= metricDistance<Metric>(y, z, dim)){
+                it = candidate_set.erase(it);
+            }
+            else{
+                it++;
+            }
+        }
+    }
+}
+
+// Insert the points in batches that grow from 1 to a part of the points, as in ParlayANN. The points of a
+// batch search the graph and choose their neighbours at the same time without changing it. Then every point
+// of the batch writes its neighbours and every node that gets reverse edges is handled by one task, so no
+// two threads change the same node. select(point, neighbours) chooses the neighbours of point and
+// reprune(node, sources) prunes the neighbours of node together with the new sources when it has more than R.
+template <typename datatype, typename Metric>
+template <typename Select, typename Reprune>
+void ANN<datatype, Metric>::batchInsert(const std::vector<int>& points, int R, Select select, Reprune reprune){
+    PROFILE_SCOPE("batchInsert");
+    std::size_t m = points.size();
+    std::size_t max_batch = std::max<std::size_t>(1, (std::size_t)(m * MAX_BATCH_FRACTION));
+
+    std::vector<std::vector<int>> selected;
+    std::vector<std::pair<int, int>> reverse_edges;
+    std::vector<std::size_t> groups;
+    for(std::size_t first = 0, size = 1; first < m; first += size, size = std::min(size * 2, max_batch)){
+        std::size_t batch = std::min(size, m - first);
+        selected.assign(batch, std::vector<int>());
+
+        parallelFor(batch, 1, [&](std::size_t i){
+            select(points[first + i], selected[i]);
+        }, this->config);
+
+        parallelFor(batch, 64, [&](std::size_t i){
+            int point = points[first + i];
+            this->G->removeNeighbours(point);
+            for(int neighbour : selected[i]){
+                this->G->addEdge(point, neighbour);
+            }
+        }, this->config);
+
+        // Group the reverse edges by the node that gets them
+        reverse_edges.clear();
+        for(std::size_t i = 0; i < batch; i++){
+            for(int neighbour : selected[i]){
+                reverse_edges.push_back(std::make_pair(neighbour, points[first + i]));
+            }
+        }
+        std::sort(reverse_edges.begin(), reverse_edges.end());
+
+        groups.clear();
+        for(std::size_t i = 0; i < reverse_edges.size(); i++){
+            if(i == 0 || reverse_edges[i].first != reverse_edges[i - 1].first)
+                groups.push_back(i);
+        }
+        groups.push_back(reverse_edges.size());
+
+        parallelFor(groups.size() - 1, 16, [&](std::size_t g){
+            int node = reverse_edges[groups[g]].first;
+            std::vector<int> sources;
+            for(std::size_t i = groups[g]; i < groups[g + 1]; i++){
+                if(!this->checkNeighbour(node, reverse_edges[i].second))
+                    sources.push_back(reverse_edges[i].second);
+            }
+
+            if(this->G->countNeighbours(node) + (int)sources.size() > R){
+                reprune(node, sources);
+            }
+            else{
+                for(int source : sources){
+                    this->G->addEdge(node, source);
+                }
+            }
+        }, this->config);
+    }
+}
+
+template <typename datatype, typename Metric>
+bool ANN<datatype, Metric>::checkFilteredFindMedoid(std::size_t num_of_filters){
+    std::size_t num_of_start_nodes = std::count_if(this->label_start_node.begin(), this->label_start_node.end(), [](int node){ return node != -1; });
+    if(num_of_start_nodes != num_of_filters){
+        throw std::invalid_argument("filteredFindMedoid: Filter map size does not match the number of filters");
+        return false;
+    }
+
+    return true;
+}
+
+template <typename datatype, typename Metric>
+int ANN<datatype, Metric>::getStartNode(float filter){
+    if(this->label_start_node.empty()){
+        this->filteredFindMedoid();
+    }
+
+    uint32_t label = this->labelId(filter);
+    if(label == UNKNOWN_LABEL){
+        return -1;
+    }
+
+    return this->label_start_node[label];
+}
+
+// FindMedoid of the Filtered-DiskANN paper with several start points per label. For every label a sample of
+// threshold nodes is taken and the first start point is the least loaded node of the sample closest to the
+// sample's centroid. The next start points are the least loaded nodes farthest from the chosen ones, so they
+// are spread over the label. The load of a node is the number of labels it is a start point for. The random
+// generator has a fixed seed, so the start points are the same after every build or load.
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::filteredFindMedoid(int threshold, int start_points){
+    if(this->node_to_label.empty()){
+        throw std::invalid_argument("filteredFindMedoid: Filter map is empty");
+        return;
+    }
+
+    PROFILE_SCOPE("filteredFindMedoid");
+
+    if(threshold <= 0 || start_points <= 0){
+        throw std::invalid_argument("filteredFindMedoid: Threshold and start points must be positive");
+    }
+
+    std::mt19937 rng(0);
+    std::size_t num_labels = this->label_values.size();
+    std::size_t dim = this->node_to_point_map[0].size();
+    std::vector<int> load(this->node_to_point_map.size(), 0);
+
+    this->label_start_node.assign(num_labels, -1);
+    this->label_start_offsets.assign(1, 0);
+    this->label_starts.clear();
+
+    std::vector<int> sample;
+    std::vector<float> min_distance;
+    std::vector<float> centroid(dim);
+    for(std::size_t l = 0; l < num_labels; l++){
+        sample.clear();
+        std::sample(this->label_nodes.begin() + this->label_offsets[l], this->label_nodes.begin() + this->label_offsets[l + 1],
+                    std::back_inserter(sample), threshold, rng);
+
+        std::fill(centroid.begin(), centroid.end(), 0.0f);
+        for(int node : sample){
+            for(std::size_t d = 0; d < dim; d++){
+                centroid[d] += (float)this->node_to_point_map[node][d] / sample.size();
+            }
+        }
+
+        // Score is minus the distance from the centroid for the first start point and then
+        // the distance from the closest chosen start point
+        min_distance.assign(sample.size(), 0.0f);
+        for(std::size_t i = 0; i < sample.size(); i++){
+            for(std::size_t d = 0; d < dim; d++){
+                float diff = (float)this->node_to_point_map[sample[i]][d] - centroid[d];
+                min_distance[i] -= diff * diff;
+            }
+        }
+
+        // The chosen start points are moved to the end of the sample
+        std::size_t remaining = sample.size();
+        std::size_t count = std::min(sample.size(), static_cast<std::size_t>(start_points));
+        for(std::size_t c = 0; c < count; c++){
+            std::size_t best = 0;
+            for(std::size_t i = 1; i < remaining; i++){
+                int load_i = load[sample[i]];
+                int load_best = load[sample[best]];
+                if(load_i < load_best || (load_i == load_best && min_distance[i] > min_distance[best]))
+                    best = i;
+            }
+
+            int start = sample[best];
+            load[start]++;
+            this->label_starts.push_back(start);
+
+            remaining--;
+            std::swap(sample[best], sample[remaining]);
+            std::swap(min_distance[best], min_distance[remaining]);
+            for(std::size_t i = 0; i < remaining; i++){
+                float distance = metricDistance<Metric>(this->node_to_point_map[sample[i]], this->node_to_point_map[start], dim);
+                min_distance[i] = c == 0 ? distance : std::min(min_distance[i], distance);
+            }
+        }
+
+        this->label_start_node[l] = this->label_starts[this->label_start_offsets.back()];
+        this->label_start_offsets.push_back((int)this->label_starts.size());
+    }
+}
+
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::calculateMedoid(){
+    PROFILE_SCOPE("calculateMedoid");
+    std::size_t n = this->node_to_point_map.size();
+    if(n == 0){
+        std::cerr   << "Error : No points in the dataset" << RESET << std::endl;
+        throw std::invalid_argument("calculateMedoid: No points in the dataset");
+        return;
+    }
+
+    // Hold the sum of distances for each point
+    std::vector<float> sum_distances(n, 0.0);
+
+    std::size_t dim = 0;
+    if(this->node_to_point_map.size() > 0)
+        dim = this->node_to_point_map[0].size();
+    else
+        throw std::invalid_argument("calculateMedoid: No points in the dataset");
+
+    // Calculate one time the distance between each pair of points to save time, with the medoid metric of Metric.
+    // In parallel every thread adds to its own sums, which are merged at the end.
+    #pragma omp parallel if(this->config.parallelAll()) num_threads(this->config.numThreads())
+    {
+        std::vector<float> local_sums(n, 0.0);
+
+        #pragma omp for schedule(dynamic, 64) nowait
+        for(std::size_t i = 0; i < n; i++){
+            for(std::size_t j = i + 1; j < n; j++){
+                float distance = metricDistance<typename Metric::MedoidMetric>(this->node_to_point_map[i], this->node_to_point_map[j], dim);
+                local_sums[i] += distance;
+                local_sums[j] += distance;
+            }
+        }
+
+        #pragma omp critical
+        for(std::size_t i = 0; i < n; i++){
+            sum_distances[i] += local_sums[i];
+        }
+    }
+
+    // Find the point with the minimum sum of distances
+    auto min_iterator = std::min_element(sum_distances.begin(), sum_distances.end());
+    std::size_t index_min = std::distance(sum_distances.begin(), min_iterator);
+    this->cached_medoid = index_min;
+}
+
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::randomMedoid(){
+    std::size_t n = this->node_to_point_map.size();
+    if(n == 0){
+        std::cerr << "Error : No points in the dataset" << RESET << std::endl;
+        throw std::invalid_argument("randomMedoid: No points in the dataset");
+        return;
+    }
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<std::size_t> dis(0, n-1);
+
+    this->cached_medoid = dis(gen);
+}
+
+// Random node or exact medoid, as config.medoid chooses
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::findMedoid(){
+    if(this->config.medoid == MedoidStrategy::Random)
+        this->randomMedoid();
+    else
+        this->calculateMedoid();
+}
+
+template <typename datatype, typename Metric>
+const int& ANN<datatype, Metric>::getMedoid(){
+    if(!this->cached_medoid.has_value())
+        this->calculateMedoid();
+
+    return this->cached_medoid.value();
+}
+
+template <typename datatype, typename Metric>
+const int& ANN<datatype, Metric>::startMedoid(){
+    if(!this->cached_medoid.has_value())
+        this->findMedoid();
+
+    return this->cached_medoid.value();
+}
+
+// NN-Descent on a subset of the nodes. Every node keeps the K closest nodes found so far and at each
+// iteration the neighbours of a node are compared with each other (local join), because a neighbour of
+// a neighbour is likely to be a neighbour too. Stops when almost no list changes. The edges found are
+// added to the graph.
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::nnDescent(const std::vector<int>& nodes, int K, int iterations, float delta){
+    std::size_t m = nodes.size();
+    if(m < 2 || K <= 0)
+        return;
+
+    PROFILE_SCOPE("nnDescent");
+    std::size_t k = std::min(static_cast<std::size_t>(K), m - 1);
+    std::size_t dim = this->node_to_point_map[nodes[0]].size();
+
+    // Neighbour lists use local indexes (position in nodes) and are sorted by distance.
+    // The flag marks neighbours that haven't taken part in a local join yet.
+    struct Neighbour{
+        int id;
+        float distance;
+        bool is_new;
+    };
+    std::vector<std::vector<Neighbour>> knn(m);
+
+    // Locks are shared between lists to bound the memory used
+    std::vector<std::mutex> locks(std::min(m, static_cast<std::size_t>(4096)));
+
+    auto distance = [&](int a, int b){
+        return metricDistance<Metric>(this->node_to_point_map[nodes[a]], this->node_to_point_map[nodes[b]], dim);
+    };
+
+    // Insert b in the list of a if it is closer than the furthest neighbour of a
+    auto update = [&](int a, int b, float dist) -> std::size_t {
+        std::lock_guard<std::mutex> guard(locks[a % locks.size()]);
+        std::vector<Neighbour>& list = knn[a];
+        if(list.size() == k && dist >= list.back().distance)
+            return 0;
+
+        for(const auto& neighbour : list){
+            if(neighbour.id == b)
+                return 0;
+        }
+
+        auto position = std::upper_bound(list.begin(), list.end(), dist,
+            [](float d, const Neighbour& neighbour){ return d < neighbour.distance; });
+        list.insert(position, {b, dist, true});
+        if(list.size() > k)
+            list.pop_back();
+
+        return 1;
+    };
+
+    // Start from k random neighbours for every node
+    #pragma omp parallel for if(this->config.parallelBuild()) num_threads(this->config.numThreads())
+    for(std::size_t i = 0; i < m; i++){
+        std::mt19937 gen(i);
+        std::uniform_int_distribution<std::size_t> dis(0, m - 1);
+        while(knn[i].size() < k){
+            std::size_t j = dis(gen);
+            if(i != j)
+                update(i, j, distance(i, j));
+        }
+    }
+
+    std::vector<std::vector<int>> new_candidates(m);
+    std::vector<std::vector<int>> old_candidates(m);
+    std::vector<std::vector<int>> new_reverse(m);
+    std::vector<std::vector<int>> old_reverse(m);
+    std::mt19937 gen(0);
+
+    for(int iteration = 0; iteration < iterations; iteration++){
+        for(std::size_t i = 0; i < m; i++){
+            new_candidates[i].clear();
+            old_candidates[i].clear();
+            new_reverse[i].clear();
+            old_reverse[i].clear();
+        }
+
+        // Split every list to new and old neighbours and keep the reverse candidates too
+        for(std::size_t i = 0; i < m; i++){
+            for(auto& neighbour : knn[i]){
+                if(neighbour.is_new){
+                    neighbour.is_new = false;
+                    new_candidates[i].push_back(neighbour.id);
+                    new_reverse[neighbour.id].push_back(i);
+                }
+                else{
+                    old_candidates[i].push_back(neighbour.id);
+                    old_reverse[neighbour.id].push_back(i);
+                }
+            }
+        }
+
+        // Add a sample of the reverse candidates so that hubs don't blow up the local joins
+        for(std::size_t i = 0; i < m; i++){
+            std::shuffle(new_reverse[i].begin(), new_reverse[i].end(), gen);
+            std::shuffle(old_reverse[i].begin(), old_reverse[i].end(), gen);
+            std::size_t new_size = std::min(new_reverse[i].size(), k);
+            std::size_t old_size = std::min(old_reverse[i].size(), k);
+            new_candidates[i].insert(new_candidates[i].end(), new_reverse[i].begin(), new_reverse[i].begin() + new_size);
+            old_candidates[i].insert(old_candidates[i].end(), old_reverse[i].begin(), old_reverse[i].begin() + old_size);
+        }
+
+        // Local join : compare new candidates with each other and with the old ones
+        std::size_t updates = 0;
+        #pragma omp parallel for schedule(dynamic) reduction(+:updates) if(this->config.parallelBuild()) num_threads(this->config.numThreads())
+        for(std::size_t i = 0; i < m; i++){
+            const std::vector<int>& fresh = new_candidates[i];
+            const std::vector<int>& old = old_candidates[i];
+
+            for(std::size_t a = 0; a < fresh.size(); a++){
+                for(std::size_t b = a + 1; b < fresh.size(); b++){
+                    if(fresh[a] == fresh[b])
+                        continue;
+
+                    float dist = distance(fresh[a], fresh[b]);
+                    updates += update(fresh[a], fresh[b], dist) + update(fresh[b], fresh[a], dist);
+                }
+
+                for(int o : old){
+                    if(fresh[a] == o)
+                        continue;
+
+                    float dist = distance(fresh[a], o);
+                    updates += update(fresh[a], o, dist) + update(o, fresh[a], dist);
+                }
+            }
+        }
+
+        if(static_cast<float>(updates) < delta * m * k)
+            break;
+    }
+
+    // Every thread writes only the neighbours of its own node
+    #pragma omp parallel for if(this->config.parallelBuild()) num_threads(this->config.numThreads())
+    for(std::size_t i = 0; i < m; i++){
+        for(const auto& neighbour : knn[i]){
+            this->G->addEdge(nodes[i], nodes[neighbour.id]);
+        }
+    }
+}
+
+// Replace the edges of the graph with an approximate kNN graph of the whole dataset
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::nnDescent(int K, int iterations, float delta){
+    std::size_t n = this->node_to_point_map.size();
+    for(std::size_t i = 0; i < n; i++){
+        this->G->removeNeighbours(i);
+    }
+
+    std::vector<int> nodes(n);
+    std::iota(nodes.begin(), nodes.end(), 0);
+    this->nnDescent(nodes, K, iterations, delta);
+}
+
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::Vamana(float alpha, int L, int R, bool nn_descent){
+    this->Vamana(std::vector<VamanaPass>{{alpha, L}}, R, nn_descent);
+}
+
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::Vamana(const std::vector<VamanaPass>& passes, int R, bool nn_descent){
+    if(passes.empty()){
+        throw std::invalid_argument("Vamana: No passes given");
+    }
+
+    PROFILE_SCOPE("Vamana");
+
+    // Start from an approximate kNN graph or from random edges
+    if(nn_descent)
+        this->nnDescent(R);
+    else
+        this->G->enforceRegular(R, this->config.parallelAll());
+
+    // Calculate medoid of dataset
+    this->findMedoid();
+
+    // Get a random permutation of 1 to n
+    std::vector<int> perm;
 
     for(size_t i=0;i<this->node_to_point_map.size();i++){
         perm.push_back(i);
@@ -564,73 +1478,86 @@ void ANN<datatype>::Vamana(float alpha, int L, int R){
     std::vector<int> neighbours;
     std::vector<int> neighbours_j;
 
-    for(size_t i = 0; i < this->node_to_point_map.size(); i++){
-        int point = perm[i];
-
-        // Get the point corresponding to the node
-        // Create the NNS and Visited sets and pass them as references
-        #if defined(PARALLEL0)
-            CompareVectors<datatype> compare(this->node_to_point_map, this->node_to_point_map[point], true);
-        #else
-            CompareVectors<datatype> compare(this->node_to_point_map, this->node_to_point_map[point]);
-        #endif
-        std::set<int, CompareVectors<datatype>> NNS(compare);
-        std::unordered_set<int> Visited;
-        NNS.insert(this->cached_medoid.value());
+    // Every pass inserts all the points again with its own alpha and L
+    for(const auto& [alpha, L] : passes){
+        PROFILE_SCOPE("Vamana pass");
+        for(size_t i = 0; i < this->node_to_point_map.size(); i++){
+            int point = perm[i];
+            ProfilePhaseTimer phase_timer(ProfilePhase::Greedy);
+
+            // Get the point corresponding to the node
+            // Create the NNS and Visited sets and pass them as references, all in the arena of the thread
+            ScratchArena& arena = ScratchArena::local();
+            arena.reset();
+            CompareVectors<datatype, Metric> compare(this->node_to_point_map, this->node_to_point_map[point], this->config.precompute_build, arena.get());
+            ScratchSet<CompareVectors<datatype, Metric>> NNS(compare, arena.get());
+            ScratchVisited Visited(arena.get());
+            NNS.insert(this->cached_medoid.value());
         
-        // Return k closest points to Xq (point) and then with robust find "better" neighbours
-        this->greedySearch(this->cached_medoid.value(), 1, L, NNS, Visited, compare);
+            // Return k closest points to Xq (point) and then with robust find "better" neighbours
+            this->greedySearch(this->cached_medoid.value(), 1, L, NNS, Visited, compare);
+            phase_timer.next(ProfilePhase::Prune);
 
-        // Transform Visited to a set with a custom comparator
-        std::set<int, CompareVectors<datatype>> VisitedRobust(compare);
-        for(auto it = Visited.begin(); it != Visited.end(); it++){
-            VisitedRobust.insert(*it);
-        }
+            // Transform Visited to a set with a custom comparator
+            ScratchSet<CompareVectors<datatype, Metric>> VisitedRobust(compare, arena.get());
+            for(auto it = Visited.begin(); it != Visited.end(); it++){
+                VisitedRobust.insert(*it);
+            }
 
-        this->robustPrune(point, VisitedRobust, alpha, R, UNFILTERED);
+            this->robustPrune(point, VisitedRobust, alpha, R, UNFILTERED);
+            phase_timer.next(ProfilePhase::Reverse);
 
-        this->neighbourNodes(point, neighbours);
+            this->neighbourNodes(point, neighbours);
 
         
-        for(auto j : neighbours){
+            for(auto j : neighbours){
             
-            // If j hasn't an outgoing edge to point, then offset is 1
-            int offset = this->checkNeighbour(j,point) ? 0 : 1;
-            // int offset = 0;
-            if((this->G->countNeighbours(j) + offset) > R){
-                std::set<int, CompareVectors<datatype>> temp(compare);
+                // If j hasn't an outgoing edge to point, then offset is 1
+                int offset = this->checkNeighbour(j,point) ? 0 : 1;
+                // int offset = 0;
+                if((this->G->countNeighbours(j) + offset) > R){
+                    ScratchSet<CompareVectors<datatype, Metric>> temp(compare, arena.get());
                 
-                this->neighbourNodes(j, neighbours_j);
-                neighbours_j.push_back(point);
+                    this->neighbourNodes(j, neighbours_j);
+                    neighbours_j.push_back(point);
 
-                for(auto k : neighbours_j){
-                    temp.insert(k);
-                }
+                    for(auto k : neighbours_j){
+                        temp.insert(k);
+                    }
 
-                neighbours_j.clear();
+                    neighbours_j.clear();
                 
-                // Call robust for j neighbours
-                this->robustPrune(j, temp, alpha, R, UNFILTERED);
-            }
-            else{
-                // Make an edge between j and point too
-                this->G->addEdge(j, point);
+                    // Call robust for j neighbours
+                    this->robustPrune(j, temp, alpha, R, UNFILTERED);
+                }
+                else{
+                    // Make an edge between j and point too
+                    this->G->addEdge(j, point);
+                }
             }
-        }
 
-        neighbours.clear();
+            neighbours.clear();
+        }
     }
+
+    this->releaseScratch();
+}
+
+// Free the scratch arenas of the build threads and keep the size of the largest one for memoryUsage
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::releaseScratch(){
+    this->build_scratch_bytes = std::max(this->build_scratch_bytes, ScratchArena::releaseAll(this->config.numThreads()));
 }
 
-template <typename datatype>
-void ANN<datatype>::filteredPruning(){
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::filteredPruning(){
     // Iterate over all the edges and if the filter values are different, remove the edge
     for(size_t i = 0; i < this->G->getNumberOfNodes(); i++){
         std::unordered_set<int>& neighbours = this->G->getNeighbours(i);
         std::vector<int> to_remove;
 
         for(int neighbour : neighbours){
-            if(this->node_to_filter_map[i] != this->node_to_filter_map[neighbour]){
+            if(!this->shareLabel(i, neighbour)){
                 to_remove.push_back(neighbour);
             }
         }
@@ -641,133 +1568,553 @@ void ANN<datatype>::filteredPruning(){
     }
 }
 
-template <typename datatype>
-void ANN<datatype>::stitchedVamana(float alpha, int L_small, int R_small, int R_stitched, int z){
-    
-    this->G->enforceRegular(z);
+// Medoid of a subset of the nodes
+template <typename datatype, typename Metric>
+int ANN<datatype, Metric>::subsetMedoid(const std::vector<int>& nodes){
+    std::size_t m = nodes.size();
+    if(m == 0){
+        throw std::invalid_argument("subsetMedoid: No points in the subset");
+    }
+
+    PROFILE_SCOPE("subsetMedoid");
 
-    // Convert map to vector for OpenMP compatibility
-    std::vector<std::pair<int, std::vector<int>>> filter_nodes;
-    for(const auto& pair : this->filter_to_node_map) {
-        filter_nodes.push_back(pair);
+    if(this->config.medoid == MedoidStrategy::Random){
+        std::mt19937 gen(m);
+        return nodes[gen() % m];
     }
 
-    #if defined(PARALLEL0)
-    #pragma omp parallel for schedule(dynamic)
-    #endif
-    for(size_t filter_idx = 0; filter_idx < filter_nodes.size(); filter_idx++) {
-        const auto& pair = filter_nodes[filter_idx];
-        std::vector<std::vector<datatype>> small_points;
-        
-        for(int node : pair.second) {
-            small_points.push_back(this->node_to_point_map[node]);
+    std::size_t dim = this->node_to_point_map[nodes[0]].size();
+    std::vector<float> sum_distances(m, 0.0);
+
+    for(std::size_t i = 0; i < m; i++){
+        for(std::size_t j = i + 1; j < m; j++){
+            float distance = metricDistance<Metric>(this->node_to_point_map[nodes[i]], this->node_to_point_map[nodes[j]], dim);
+            sum_distances[i] += distance;
+            sum_distances[j] += distance;
         }
+    }
 
-        ANN<datatype>* small_graph = new ANN<datatype>(small_points);
-        small_graph->Vamana(alpha, L_small, R_small);
+    auto min_iterator = std::min_element(sum_distances.begin(), sum_distances.end());
+    return nodes[std::distance(sum_distances.begin(), min_iterator)];
+}
 
-        // Pre-collect all edges to add
-        std::vector<std::pair<int, int>> edges_to_add;
-        for(size_t i = 0; i < small_points.size(); i++) {
-            int node = pair.second[i];
-            std::vector<int> neighbours;
-            small_graph->neighbourNodes(int(i), neighbours);
-            
-            for(int neighbour : neighbours) {
-                edges_to_add.emplace_back(node, pair.second[neighbour]);
+// Vamana on a subset of the nodes that works directly on the vectors and the graph of this index.
+// The nodes of the subset must not have any edges yet, so that the greedy searches stay inside the subset.
+// local_index maps every node of the subset to its position in nodes and keeps the distance maps small.
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::subsetVamana(const std::vector<int>& nodes, const std::vector<int>& local_index, const std::vector<VamanaPass>& passes, int R, bool nn_descent){
+    std::size_t m = nodes.size();
+    if(m == 0)
+        return;
+
+    PROFILE_SCOPE("subsetVamana");
+
+    // Start from an approximate kNN graph or from R random edges inside the subset
+    if(nn_descent){
+        this->nnDescent(nodes, R, NN_DESCENT_ITERATIONS, NN_DESCENT_DELTA);
+    }
+    else{
+        std::size_t upper_limit = std::min(static_cast<std::size_t>(R), m - 1);
+        std::mt19937 gen(m);
+        for(std::size_t i = 0; i < m; i++){
+            while(static_cast<std::size_t>(this->G->countNeighbours(nodes[i])) < upper_limit){
+                std::size_t j = gen() % m;
+                if(i != j)
+                    this->G->addEdge(nodes[i], nodes[j]);
             }
         }
+    }
 
-        // Add edges in a single critical section
-        #if defined(PARALLEL0)
-        #pragma omp critical
-        #endif
-        {
-            for(const auto& edge : edges_to_add) {
-                this->G->addEdge(edge.first, edge.second);
+    int medoid = this->subsetMedoid(nodes);
+
+    std::vector<int> perm(nodes);
+    std::shuffle(perm.begin(), perm.end(), std::default_random_engine(0));
+
+    // Large subsets are inserted in parallel batches
+    if(m >= BATCH_LABEL_SIZE){
+        for(const auto& [alpha, L] : passes){
+            auto select = [&, alpha = alpha, L = L](int point, std::vector<int>& selected){
+                ProfilePhaseTimer phase_timer(ProfilePhase::Greedy);
+                ScratchArena& arena = ScratchArena::local();
+                arena.reset();
+                CompareVectors<datatype, Metric> compare(this->node_to_point_map, this->node_to_point_map[point], local_index, m, arena.get());
+                ScratchSet<CompareVectors<datatype, Metric>> NNS(compare, arena.get());
+                ScratchVisited Visited(arena.get());
+                NNS.insert(medoid);
+                this->greedySearch(medoid, 1, L, NNS, Visited, compare);
+                phase_timer.next(ProfilePhase::Prune);
+
+                ScratchSet<CompareVectors<datatype, Metric>> VisitedRobust(Visited.begin(), Visited.end(), compare, arena.get());
+                this->selectNeighbours(point, VisitedRobust, alpha, R, UNFILTERED, selected);
+            };
+
+            auto reprune = [&, alpha = alpha](int node, const std::vector<int>& sources){
+                ProfilePhaseTimer phase_timer(ProfilePhase::Reverse);
+                ScratchArena& arena = ScratchArena::local();
+                arena.reset();
+                CompareVectors<datatype, Metric> compare(this->node_to_point_map, this->node_to_point_map[node], local_index, m, arena.get());
+                ScratchSet<CompareVectors<datatype, Metric>> temp(sources.begin(), sources.end(), compare, arena.get());
+                this->robustPrune(node, temp, alpha, R, UNFILTERED);
+            };
+
+            this->batchInsert(perm, R, select, reprune);
+        }
+        return;
+    }
+
+    // Neighbours vectors to use inside the loop
+    std::vector<int> neighbours;
+    std::vector<int> neighbours_j;
+
+    for(const auto& [alpha, L] : passes){
+        for(int point : perm){
+            ProfilePhaseTimer phase_timer(ProfilePhase::Greedy);
+            ScratchArena& arena = ScratchArena::local();
+            arena.reset();
+            CompareVectors<datatype, Metric> compare(this->node_to_point_map, this->node_to_point_map[point], local_index, m, arena.get());
+            ScratchSet<CompareVectors<datatype, Metric>> NNS(compare, arena.get());
+            ScratchVisited Visited(arena.get());
+            NNS.insert(medoid);
+
+            this->greedySearch(medoid, 1, L, NNS, Visited, compare);
+            phase_timer.next(ProfilePhase::Prune);
+
+            ScratchSet<CompareVectors<datatype, Metric>> VisitedRobust(compare, arena.get());
+            for(auto it = Visited.begin(); it != Visited.end(); it++){
+                VisitedRobust.insert(*it);
+            }
+
+            this->robustPrune(point, VisitedRobust, alpha, R, UNFILTERED);
+            phase_timer.next(ProfilePhase::Reverse);
+
+            this->neighbourNodes(point, neighbours);
+            for(auto j : neighbours){
+                int offset = this->checkNeighbour(j, point) ? 0 : 1;
+                if((this->G->countNeighbours(j) + offset) > R){
+                    ScratchSet<CompareVectors<datatype, Metric>> temp(compare, arena.get());
+
+                    this->neighbourNodes(j, neighbours_j);
+                    neighbours_j.push_back(point);
+
+                    for(auto k : neighbours_j){
+                        temp.insert(k);
+                    }
+
+                    neighbours_j.clear();
+                    this->robustPrune(j, temp, alpha, R, UNFILTERED);
+                }
+                else{
+                    this->G->addEdge(j, point);
+                }
             }
+
+            neighbours.clear();
         }
+    }
+}
 
-        delete small_graph;
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::stitchedVamana(float alpha, int L_small, int R_small, int R_stitched, int z, bool nn_descent){
+    this->stitchedVamana(std::vector<VamanaPass>{{alpha, L_small}}, R_small, R_stitched, z, nn_descent);
+}
+
+// The passes are used for the Vamana of every filter and the alpha of the last pass for stitching
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::stitchedVamana(const std::vector<VamanaPass>& passes, int R_small, int R_stitched, int z, bool nn_descent){
+    if(passes.empty()){
+        throw std::invalid_argument("stitchedVamana: No passes given");
     }
 
-    #if defined(PARALLEL0)
-    #pragma omp parallel for schedule(dynamic)
-    #endif
-    for(size_t filter_idx = 0; filter_idx < filter_nodes.size(); filter_idx++) {
-        const auto& pair = filter_nodes[filter_idx];
-        for(int node : pair.second) {
-            std::vector<int> neighbours;
-            this->neighbourNodes(node, neighbours);
-            std::set<int> candidate_set;
-            for(int neighbour : neighbours) {
-                candidate_set.insert(neighbour);
+    PROFILE_SCOPE("stitchedVamana");
+
+    float alpha = passes.back().alpha;
+    std::size_t n = this->node_to_point_map.size();
+
+    // Keep the random edges aside and build the filters on an empty graph
+    Graph* random_graph = this->G;
+    random_graph->enforceRegular(z, this->config.parallelAll());
+    this->G = new Graph(n, true);
+
+    // Position of every node inside the node list of its label, set before the label is built
+    std::size_t num_labels = this->label_values.size();
+    std::vector<int> local_index(n);
+
+    // Nodes with several labels would mix the sub-graphs, so then every label is built alone on
+    // an empty graph and its edges are moved to the result
+    Graph* label_graph = this->shared_labels ? new Graph(n, true) : nullptr;
+
+    auto build_label = [&](std::size_t label) {
+        std::vector<int> nodes = this->labelNodes(label);
+        for(std::size_t j = 0; j < nodes.size(); j++) {
+            local_index[nodes[j]] = (int)j;
+        }
+
+        if(label_graph == nullptr) {
+            this->subsetVamana(nodes, local_index, passes, R_small, nn_descent);
+            return;
+        }
+
+        std::swap(this->G, label_graph);
+        this->subsetVamana(nodes, local_index, passes, R_small, nn_descent);
+        std::swap(this->G, label_graph);
+
+        for(int node : nodes) {
+            for(int neighbour : label_graph->getNeighbours(node)) {
+                this->G->addEdge(node, neighbour);
             }
-            this->robustPrune(node, candidate_set, alpha, R_stitched, FILTERED);
+            label_graph->removeNeighbours(node);
+        }
+    };
+
+    // Every filter writes only the neighbours of its own nodes, so the builds run as tasks from the largest
+    // filter to the smallest
+    if(this->shared_labels) {
+        for(std::size_t label = 0; label < num_labels; label++) {
+            build_label(label);
         }
     }
+    else {
+        auto label_size = [&](std::size_t label) { return this->label_offsets[label + 1] - this->label_offsets[label]; };
+        parallelTasks(num_labels, label_size, build_label, this->config);
+    }
+    delete label_graph;
+
+    // Add back the random edges
+    for(std::size_t i = 0; i < n; i++) {
+        for(int neighbour : random_graph->getNeighbours(i)) {
+            this->G->addEdge(i, neighbour);
+        }
+    }
+    delete random_graph;
+
+    // Prune the neighbours of every node ordered by their distance to the node. Every thread has its own
+    // local index, so that the distance map of a node has one entry for the node and one for every neighbour.
+    // Pruning a node changes only its own neighbours, so chunks of nodes run in parallel.
+    std::vector<int> candidate_index(n);
+    PROFILE_SCOPE("stitch prune");
+
+    #pragma omp parallel for schedule(dynamic, 256) firstprivate(candidate_index) if(this->config.parallelBuild()) num_threads(this->config.numThreads())
+    for(std::size_t node = 0; node < n; node++) {
+        std::vector<int> neighbours;
+        this->neighbourNodes(node, neighbours);
+
+        candidate_index[node] = 0;
+        for(std::size_t i = 0; i < neighbours.size(); i++) {
+            candidate_index[neighbours[i]] = (int)(i + 1);
+        }
+
+        CompareVectors<datatype, Metric> compare(this->node_to_point_map, this->node_to_point_map[node], candidate_index, neighbours.size() + 1);
+        std::set<int, CompareVectors<datatype, Metric>> candidate_set(compare);
+        for(int neighbour : neighbours) {
+            candidate_set.insert(neighbour);
+        }
+
+        this->robustPrune(node, candidate_set, alpha, R_stitched, FILTERED);
+    }
+
+    this->releaseScratch();
 }
 
-template <typename datatype>
-void ANN<datatype>::filteredVamana(float alpha, int L, int R, int z){
-    
-    this->G->enforceRegular(z);
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::filteredVamana(float alpha, int L, int R, int z, bool nn_descent){
+    this->filteredVamana(std::vector<VamanaPass>{{alpha, L}}, R, z, nn_descent);
+}
+
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::filteredVamana(const std::vector<VamanaPass>& passes, int R, int z, bool nn_descent){
+    if(passes.empty()){
+        throw std::invalid_argument("filteredVamana: No passes given");
+    }
+
+    PROFILE_SCOPE("filteredVamana");
+
+    this->G->enforceRegular(z, this->config.parallelAll());
+
+    // Add an approximate kNN graph inside every filter, so that the graph stays filtered
+    if(nn_descent){
+        for(uint32_t label = 0; label < this->label_values.size(); label++){
+            this->nnDescent(this->labelNodes(label), R, NN_DESCENT_ITERATIONS, NN_DESCENT_DELTA);
+        }
+    }
 
     // Calculate medoid of dataset
     this->filteredFindMedoid();
 
-    // Convert map to vector for OpenMP compatibility
-    std::vector<std::pair<int, std::vector<int>>> filter_nodes;
-    for(const auto& pair : this->filter_to_node_map) {
-        std::vector<int> temp;
-        for(int node : pair.second){
-            temp.push_back(node);
-        }
+    if(this->shared_labels){
+        this->sharedLabelVamana(passes, R);
+        this->releaseScratch();
+        return;
+    }
 
-        // Shuffle the nodes
+    // Shuffled nodes of every label
+    std::vector<std::pair<uint32_t, std::vector<int>>> filter_nodes;
+    for(uint32_t label = 0; label < this->label_values.size(); label++) {
+        std::vector<int> temp = this->labelNodes(label);
         std::shuffle(temp.begin(), temp.end(), std::default_random_engine(0));
-        filter_nodes.push_back(std::make_pair(pair.first, temp));
+        filter_nodes.push_back(std::make_pair(label, temp));
+    }
+
+    // Every filter is a task and the largest filters start first. The points of a large filter are
+    // inserted in parallel batches, so that one large filter doesn't keep a single thread busy at the end.
+    auto filter_size = [&](std::size_t filteridx){ return filter_nodes[filteridx].second.size(); };
+    parallelTasks(filter_nodes.size(), filter_size, [&](std::size_t filteridx){
+        PROFILE_SCOPE("filter");
+        uint32_t label = filter_nodes[filteridx].first;
+        if(filter_nodes[filteridx].second.size() >= BATCH_LABEL_SIZE){
+            for(const auto& [alpha, L] : passes){
+                auto select = [&, alpha = alpha, L = L](int point, std::vector<int>& selected){
+                    ProfilePhaseTimer phase_timer(ProfilePhase::Greedy);
+                    ScratchArena& arena = ScratchArena::local();
+                    arena.reset();
+                    CompareVectors<datatype, Metric> compare(this->node_to_point_map, this->node_to_point_map[point], false, arena.get());
+                    ScratchSet<CompareVectors<datatype, Metric>> NNS(compare, arena.get());
+                    ScratchVisited Visited(arena.get());
+
+                    int temporary_point = this->label_start_node[label];
+                    NNS.insert(temporary_point);
+                    this->labelGreedySearch(temporary_point, 1, L, label, NNS, Visited, compare);
+                    phase_timer.next(ProfilePhase::Prune);
+
+                    ScratchSet<CompareVectors<datatype, Metric>> VisitedRobust(Visited.begin(), Visited.end(), compare, arena.get());
+                    this->selectNeighbours(point, VisitedRobust, alpha, R, FILTERED, selected);
+                };
+
+                auto reprune = [&, alpha = alpha](int node, const std::vector<int>& sources){
+                    ProfilePhaseTimer phase_timer(ProfilePhase::Reverse);
+                    ScratchArena& arena = ScratchArena::local();
+                    arena.reset();
+                    CompareVectors<datatype, Metric> compare(this->node_to_point_map, this->node_to_point_map[node], false, arena.get());
+                    ScratchSet<CompareVectors<datatype, Metric>> temp(sources.begin(), sources.end(), compare, arena.get());
+                    this->robustPrune(node, temp, alpha, R, FILTERED);
+                };
+
+                this->batchInsert(filter_nodes[filteridx].second, R, select, reprune);
+            }
+            return;
+        }
+
+        // Neighbours vectors to use inside the loop
+        std::vector<int> neighbours;
+        std::vector<int> neighbours_j;
+
+        // Every pass inserts all the points of the filter again with its own alpha and L
+        for(const auto& [alpha, L] : passes){
+            for(size_t i = 0; i < filter_nodes[filteridx].second.size(); i++){
+                int point = filter_nodes[filteridx].second[i];
+                ProfilePhaseTimer phase_timer(ProfilePhase::Greedy);
+        
+                ScratchArena& arena = ScratchArena::local();
+                arena.reset();
+                CompareVectors<datatype, Metric> compare(this->node_to_point_map, this->node_to_point_map[point], false, arena.get());
+                ScratchSet<CompareVectors<datatype, Metric>> NNS(compare, arena.get());
+                ScratchVisited Visited(arena.get());
+
+                int temporary_point = this->label_start_node[label];
+
+                NNS.insert(temporary_point);
+
+                // Return k closest points to Xq (point) and then with robust find "better" neighbours
+                this->labelGreedySearch(temporary_point, 1, L, label, NNS, Visited, compare);
+                phase_timer.next(ProfilePhase::Prune);
+
+                // Transform Visited to a set with a custom comparator
+                ScratchSet<CompareVectors<datatype, Metric>> VisitedRobust(compare, arena.get());
+                for(auto it = Visited.begin(); it != Visited.end(); it++){
+                    VisitedRobust.insert(*it);
+                }
+
+                this->robustPrune(point, VisitedRobust, alpha, R, FILTERED);
+                phase_timer.next(ProfilePhase::Reverse);
+
+                this->neighbourNodes(point, neighbours);
+
+                for(auto j : neighbours){
+                    this->G->addEdge(j, point);
+
+                    if(this->G->countNeighbours(j) > R){
+                        // Call robust for j neighbours
+                        ScratchSet<CompareVectors<datatype, Metric>> temp(compare, arena.get());
+
+                        this->neighbourNodes(j, neighbours_j);
+                        for(auto k : neighbours_j){
+                            temp.insert(k);
+                        }
+
+                        neighbours_j.clear();
+                        this->robustPrune(j, temp, alpha, R, FILTERED);
+                    }
+                }
+                neighbours.clear();
+            }
+        }
+    }, this->config);
+
+    this->releaseScratch();
+}
+
+// Keep at most B edges from point to nodes that share no label with it, chosen from the candidates and the
+// current bridge edges with the alpha rule of robustPrune. The edges inside the labels are not changed.
+template <typename datatype, typename Metric>
+template <typename Compare>
+void ANN<datatype, Metric>::pruneBridges(int point, std::set<int, Compare>& candidate_set, float alpha, int B){
+    std::vector<int> neighbours;
+    this->neighbourNodes(point, neighbours);
+    for(int neighbour : neighbours){
+        if(!this->shareLabel(point, neighbour)){
+            candidate_set.insert(neighbour);
+            this->G->removeEdge(point, neighbour);
+        }
+    }
+    candidate_set.erase(point);
+
+    int count = 0;
+    while(!candidate_set.empty() && count < B){
+        int closest_point = *(candidate_set.begin());
+        candidate_set.erase(candidate_set.begin());
+        this->G->addEdge(point, closest_point);
+        count++;
+
+        const auto& x = this->node_to_point_map[closest_point];
+        const auto& z = this->node_to_point_map[point];
+        std::size_t dim = z.size();
+        for(auto it = candidate_set.begin(); it != candidate_set.end();){
+            const auto& y = this->node_to_point_map[*it];
+            if(Metric::relax(alpha, metricDistance<Metric>(x, y, dim)) <= metricDistance<Metric>(y, z, dim))
+                it = candidate_set.erase(it);
+            else
+                it++;
+        }
+    }
+}
+
+// Add up to B edges from every node to close nodes of other labels, plus a global medoid, so that an unfiltered
+// query can run greedySearch from getMedoid() instead of starting from every label. The nodes are inserted like
+// in Vamana: a greedySearch from the medoid over the whole graph gives the candidates of other labels and the
+// reverse edges connect the labels of the nodes inserted later. Filtered searches skip the bridge edges.
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::addBridgeEdges(int B, float alpha, int L){
+    if(B <= 0)
+        return;
+
+    if(this->node_label_signature.size() != this->node_to_point_map.size()){
+        std::cerr   << "Error : Points don't have filters" << RESET << std::endl;
+        throw std::invalid_argument("addBridgeEdges: Points don't have filters");
+    }
+
+    PROFILE_SCOPE("addBridgeEdges");
+
+    // Calculate medoid of dataset
+    this->findMedoid();
+    int medoid = this->cached_medoid.value();
+
+    std::vector<int> perm(this->node_to_point_map.size());
+    std::iota(perm.begin(), perm.end(), 0);
+    std::shuffle(perm.begin(), perm.end(), std::default_random_engine(0));
+
+    std::vector<int> neighbours;
+    std::vector<int> bridges;
+    std::vector<int> bridge_index(this->node_to_point_map.size());
+    for(int point : perm){
+        CompareVectors<datatype, Metric> compare(this->node_to_point_map, this->node_to_point_map[point]);
+        std::set<int, CompareVectors<datatype, Metric>> NNS(compare);
+        std::unordered_set<int> Visited;
+        NNS.insert(medoid);
+        this->greedySearch(medoid, 1, L, NNS, Visited, compare);
+
+        std::set<int, CompareVectors<datatype, Metric>> candidates(compare);
+        for(int node : Visited){
+            if(!this->shareLabel(point, node))
+                candidates.insert(node);
+        }
+        this->pruneBridges(point, candidates, alpha, B);
+
+        // Reverse edges from the new bridges back to point
+        bridges.clear();
+        this->neighbourNodes(point, neighbours);
+        for(int neighbour : neighbours){
+            if(!this->shareLabel(point, neighbour))
+                bridges.push_back(neighbour);
+        }
+        neighbours.clear();
+
+        for(int bridge : bridges){
+            if(this->checkNeighbour(bridge, point))
+                continue;
+
+            std::vector<int> bridge_neighbours;
+            this->neighbourNodes(bridge, neighbours);
+            for(int neighbour : neighbours){
+                if(!this->shareLabel(bridge, neighbour))
+                    bridge_neighbours.push_back(neighbour);
+            }
+            neighbours.clear();
+
+            if((int)bridge_neighbours.size() < B){
+                this->G->addEdge(bridge, point);
+                continue;
+            }
+
+            // The distance map needs entries only for point and the bridges of bridge
+            bridge_index[point] = 0;
+            for(std::size_t i = 0; i < bridge_neighbours.size(); i++){
+                bridge_index[bridge_neighbours[i]] = (int)(i + 1);
+            }
+
+            CompareVectors<datatype, Metric> compare_bridge(this->node_to_point_map, this->node_to_point_map[bridge], bridge_index, bridge_neighbours.size() + 1);
+            std::set<int, CompareVectors<datatype, Metric>> temp(compare_bridge);
+            temp.insert(point);
+            this->pruneBridges(bridge, temp, alpha, B);
+        }
     }
+}
+
+// FilteredVamana of the Filtered-DiskANN paper for points with several labels. Every point is inserted once per
+// pass with the union of the Visited sets of the searches for each one of its labels. A point is in the sub-graphs
+// of many labels, so the labels can't be built in parallel.
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::sharedLabelVamana(const std::vector<VamanaPass>& passes, int R){
+    PROFILE_SCOPE("sharedLabelVamana");
+    std::vector<int> perm(this->node_to_point_map.size());
+    std::iota(perm.begin(), perm.end(), 0);
+    std::shuffle(perm.begin(), perm.end(), std::default_random_engine(0));
 
     // Neighbours vectors to use inside the loop
     std::vector<int> neighbours;
     std::vector<int> neighbours_j;
-    
-    #if defined(PARALLEL0)
-    #pragma omp parallel for private(neighbours, neighbours_j) schedule(dynamic)
-    #endif
-    for(size_t filteridx = 0; filteridx < filter_nodes.size(); filteridx++){
-        for(size_t i = 0; i < filter_nodes[filteridx].second.size(); i++){
-            int point = filter_nodes[filteridx].second[i];
-        
-            CompareVectors<datatype> compare(this->node_to_point_map, this->node_to_point_map[point]);
-            std::set<int, CompareVectors<datatype>> NNS(compare);
-            std::unordered_set<int> Visited;
 
-            int temporary_point = this->filter_to_start_node[this->node_to_filter_map[point]];
-            float filter = this->node_to_filter_map[point];
+    for(const auto& [alpha, L] : passes){
+        for(int point : perm){
+            ProfilePhaseTimer phase_timer(ProfilePhase::Greedy);
+            ScratchArena& arena = ScratchArena::local();
+            arena.reset();
+            CompareVectors<datatype, Metric> compare(this->node_to_point_map, this->node_to_point_map[point], false, arena.get());
+            ScratchSet<CompareVectors<datatype, Metric>> VisitedRobust(compare, arena.get());
 
-            NNS.insert(temporary_point);
+            for(int j = this->node_label_offsets[point]; j < this->node_label_offsets[point + 1]; j++){
+                uint32_t label = this->node_label_ids[j];
+                int temporary_point = this->label_start_node[label];
 
-            // Return k closest points to Xq (point) and then with robust find "better" neighbours
-            this->filteredGreedySearch(temporary_point, 1, L, filter, NNS, Visited, compare);
+                ScratchSet<CompareVectors<datatype, Metric>> NNS(compare, arena.get());
+                ScratchVisited Visited(arena.get());
+                NNS.insert(temporary_point);
+                this->labelGreedySearch(temporary_point, 1, L, label, NNS, Visited, compare);
 
-            // Transform Visited to a set with a custom comparator
-            std::set<int, CompareVectors<datatype>> VisitedRobust(compare);
-            for(auto it = Visited.begin(); it != Visited.end(); it++){
-                VisitedRobust.insert(*it);
+                VisitedRobust.insert(Visited.begin(), Visited.end());
             }
 
+            if(VisitedRobust.empty())
+                continue;
+
+            phase_timer.next(ProfilePhase::Prune);
             this->robustPrune(point, VisitedRobust, alpha, R, FILTERED);
+            phase_timer.next(ProfilePhase::Reverse);
 
             this->neighbourNodes(point, neighbours);
-
             for(auto j : neighbours){
                 this->G->addEdge(j, point);
 
                 if(this->G->countNeighbours(j) > R){
-                    // Call robust for j neighbours
-                    std::set<int, CompareVectors<datatype>> temp(compare);
+                    ScratchSet<CompareVectors<datatype, Metric>> temp(compare, arena.get());
 
                     this->neighbourNodes(j, neighbours_j);
                     for(auto k : neighbours_j){
@@ -783,8 +2130,118 @@ void ANN<datatype>::filteredVamana(float alpha, int L, int R, int z){
     }
 }
 
-template <typename datatype>
-void ANN<datatype>::saveGraph(const std::string& file_path) {
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::reorder(ReorderStrategy strategy){
+    if(strategy == ReorderStrategy::None)
+        return;
+
+    PROFILE_SCOPE("reorder");
+    std::vector<int> order;
+    if(strategy == ReorderStrategy::BFS){
+        // Filtered and stitched graphs start from every label, the others from the medoid that the build used
+        std::vector<int> starts;
+        for(int start : this->label_start_node){
+            if(start != -1)
+                starts.push_back(start);
+        }
+        if(starts.empty())
+            starts.push_back(this->startMedoid());
+        order = bfsOrder(*this->G, starts);
+    }
+    else if(strategy == ReorderStrategy::RCM)
+        order = rcmOrder(*this->G);
+    else
+        order = gorderOrder(*this->G);
+
+    this->applyOrder(order, true);
+}
+
+// Node order[i] becomes node i. The graph is left as it is if it is already in the new order, e.g. when it is loaded.
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::applyOrder(const std::vector<int>& order, bool permute_graph){
+    std::size_t n = this->node_to_point_map.size();
+    if(order.size() != n){
+        std::cerr << "Error : Order has " << order.size() << " nodes instead of " << n << RESET << std::endl;
+        throw std::invalid_argument("applyOrder: Size of the order does not match the points");
+    }
+    std::vector<int> new_id = inverseOrder(order);
+
+    // The vectors are copied to new allocations in the new order, so that close ids are close in memory too
+    std::vector<std::vector<datatype>> points;
+    points.reserve(n);
+    for(int old_id : order){
+        points.push_back(this->node_to_point_map[old_id]);
+    }
+    this->node_to_point_map.swap(points);
+    std::vector<std::vector<datatype>>().swap(points);
+
+    if(permute_graph)
+        this->G->permute(new_id);
+
+    // The label ids stay the same, since label_ids already has every filter value
+    if(!this->node_label_offsets.empty()){
+        std::vector<float> filters;
+        std::vector<int> offsets(n + 1, 0);
+        filters.reserve(this->node_label_ids.size());
+        for(std::size_t i = 0; i < n; i++){
+            for(int j = this->node_label_offsets[order[i]]; j < this->node_label_offsets[order[i] + 1]; j++){
+                filters.push_back(this->label_values[this->node_label_ids[j]]);
+            }
+            offsets[i + 1] = (int)filters.size();
+        }
+        this->initLabels(filters, offsets);
+    }
+
+    if(!this->node_to_timestamp.empty()){
+        std::vector<float> timestamps(n);
+        for(std::size_t i = 0; i < n; i++){
+            timestamps[i] = this->node_to_timestamp[order[i]];
+        }
+        this->initTimestamps(timestamps);
+    }
+
+    for(int& start : this->label_start_node){
+        if(start != -1)
+            start = new_id[start];
+    }
+    for(int& start : this->label_starts){
+        start = new_id[start];
+    }
+    if(this->cached_medoid.has_value())
+        this->cached_medoid = new_id[this->cached_medoid.value()];
+
+    // Ids of the input, also after several orders
+    std::vector<int> original(n);
+    for(std::size_t i = 0; i < n; i++){
+        original[i] = this->node_to_original.empty() ? order[i] : this->node_to_original[order[i]];
+    }
+    this->node_to_original.swap(original);
+}
+
+template <typename datatype, typename Metric>
+MemoryReport ANN<datatype, Metric>::memoryUsage(){
+    MemoryReport report;
+    report.add("vectors", nestedVectorBytes(this->node_to_point_map));
+    report.add("adjacency", this->G->memoryUsage());
+
+    report.add("labels", hashMapBytes(this->label_ids) + vectorBytes(this->label_values) + vectorBytes(this->label_offsets)
+                       + vectorBytes(this->label_nodes) + vectorBytes(this->label_start_node) + vectorBytes(this->label_start_offsets)
+                       + vectorBytes(this->label_starts) + vectorBytes(this->node_to_label));
+    report.add("node labels", vectorBytes(this->node_label_offsets) + vectorBytes(this->node_label_ids) + vectorBytes(this->node_label_signature));
+    report.add("timestamps", vectorBytes(this->node_to_timestamp) + vectorBytes(this->timestamp_order));
+    if(!this->node_to_original.empty())
+        report.add("id map", vectorBytes(this->node_to_original));
+
+    // Every thread of the build keeps a scratch arena with the distance map of all the points and the sets of an
+    // insertion until the build ends. Without a build only the distance map is counted.
+    std::size_t threads = this->config.parallelBuild() ? (std::size_t)this->config.numThreads() : 1;
+    std::size_t arena = this->build_scratch_bytes > 0 ? this->build_scratch_bytes : this->node_to_point_map.size() * sizeof(float);
+    report.add("scratch (estimate)", threads * arena);
+    return report;
+}
+
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::saveGraph(const std::string& file_path) {
     namespace fs = std::filesystem;
     if (fs::exists(file_path)) {
         std::cerr << "Error: File \"" << file_path << "\" already exists.\n";
@@ -812,11 +2269,26 @@ void ANN<datatype>::saveGraph(const std::string& file_path) {
         }
     }
 
+    // A reordered graph keeps the original id of every node after the adjacency, older files end here
+    if(!this->node_to_original.empty()){
+        const uint64_t tag = ID_MAP_TAG;
+        out_file.write(reinterpret_cast<const char*>(&tag), sizeof(tag));
+        out_file.write(reinterpret_cast<const char*>(this->node_to_original.data()), num_nodes * sizeof(int));
+    }
+
+    // The start node of the build, so that a loaded graph with bridge edges is searched from the same node
+    if(this->cached_medoid.has_value()){
+        const uint64_t tag = MEDOID_TAG;
+        const int medoid = this->cached_medoid.value();
+        out_file.write(reinterpret_cast<const char*>(&tag), sizeof(tag));
+        out_file.write(reinterpret_cast<const char*>(&medoid), sizeof(medoid));
+    }
+
     out_file.close();
 }
 
-template <typename datatype>
-void ANN<datatype>::loadGraph(const std::string& file_path) {
+template <typename datatype, typename Metric>
+void ANN<datatype, Metric>::loadGraph(const std::string& file_path) {
     std::ifstream in_file(file_path, std::ios::binary);
     if (!in_file) {
         std::cerr << "Error: Could not open file \"" << file_path << "\".\n";
@@ -844,90 +2316,83 @@ void ANN<datatype>::loadGraph(const std::string& file_path) {
         }
     }
 
+    // The graph is in the order of the file, so the points and the labels follow it. The id map and the medoid
+    // are optional sections after the adjacency, older files end before them.
+    std::vector<int> original(num_nodes);
+    std::iota(original.begin(), original.end(), 0);
+    std::optional<int> medoid;
+
+    uint64_t tag = 0;
+    while(in_file.read(reinterpret_cast<char*>(&tag), sizeof(tag))){
+        if(tag == ID_MAP_TAG){
+            if(!in_file.read(reinterpret_cast<char*>(original.data()), num_nodes * sizeof(int))){
+                std::cerr << "Error: Id map of \"" << file_path << "\" is incomplete.\n";
+                throw std::invalid_argument("loadGraph: Incomplete id map");
+            }
+        }
+        else if(tag == MEDOID_TAG){
+            int node = -1;
+            if(!in_file.read(reinterpret_cast<char*>(&node), sizeof(node)) || node < 0 || (std::size_t)node >= num_nodes){
+                std::cerr << "Error: Medoid of \"" << file_path << "\" is invalid.\n";
+                throw std::invalid_argument("loadGraph: Invalid medoid");
+            }
+            medoid = node;
+        }
+        else{
+            break;
+        }
+    }
     in_file.close();
+
+    if(!this->node_to_original.empty() || !std::is_sorted(original.begin(), original.end())){
+        // The points may be in an order of their own already
+        std::vector<int> current = this->node_to_original.empty() ? std::vector<int>() : inverseOrder(this->node_to_original);
+        std::vector<int> order(num_nodes);
+        for(std::size_t i = 0; i < num_nodes; i++){
+            if(original[i] < 0 || (std::size_t)original[i] >= num_nodes){
+                std::cerr << "Error: Id map of \"" << file_path << "\" has an id out of range.\n";
+                throw std::invalid_argument("loadGraph: Id out of range");
+            }
+            order[i] = current.empty() ? original[i] : current[original[i]];
+        }
+        this->applyOrder(order, false);
+    }
+
+    // The medoid is an id of the file like the graph, and the one of an older file is found again if it is needed
+    this->cached_medoid = medoid;
 }
 
-// Explicit instantiation of ANN class for datatype int, float and unsigned char
-template class ANN<int>;
-template class ANN<float>;
-template class ANN<unsigned char>;
-
-// Explicit instantiation for filteredGreedySearch with the different datatypes
-template void ANN<int>::filteredGreedySearch<CompareVectors<int>>(
-    const int&, 
-    int, 
-    int, 
-    const float&, 
-    std::set<int, CompareVectors<int>>&, 
-    std::unordered_set<int>&, 
-    CompareVectors<int>&
-);
-template void ANN<float>::filteredGreedySearch<CompareVectors<float>>(
-    const int&, 
-    int, 
-    int, 
-    const float&, 
-    std::set<int, CompareVectors<float>>&, 
-    std::unordered_set<int>&, 
-    CompareVectors<float>&
-);
-template void ANN<unsigned char>::filteredGreedySearch<CompareVectors<unsigned char>>(
-    const int&, 
-    int, 
-    int, 
-    const float&, 
-    std::set<int, CompareVectors<unsigned char>>&, 
-    std::unordered_set<int>&, 
-    CompareVectors<unsigned char>&
-);
-
-// Explicit instantiation for greedySearch with the different datatypes
-template void ANN<int>::greedySearch<CompareVectors<int>>(
-    const int&, 
-    int, 
-    int, 
-    std::set<int, CompareVectors<int>>&, 
-    std::unordered_set<int>&, 
-    CompareVectors<int>&
-);
-template void ANN<float>::greedySearch<CompareVectors<float>>(
-    const int&, 
-    int, 
-    int, 
-    std::set<int, CompareVectors<float>>&, 
-    std::unordered_set<int>&, 
-    CompareVectors<float>&
-);
-template void ANN<unsigned char>::greedySearch<CompareVectors<unsigned char>>(
-    const int&, 
-    int, 
-    int, 
-    std::set<int, CompareVectors<unsigned char>>&, 
-    std::unordered_set<int>&, 
-    CompareVectors<unsigned char>&
-);
-
-// Explicit instantiation for robustPrune with the different datatypes
-template void ANN<int>::robustPrune<CompareVectors<int>>(
-    const int&, 
-    std::set<int, CompareVectors<int>>&, 
-    const float, 
-    const int,
-    bool
-);
-
-template void ANN<float>::robustPrune<CompareVectors<float>>(
-    const int&, 
-    std::set<int, CompareVectors<float>>&, 
-    const float, 
-    const int,
-    bool
-);
-
-template void ANN<unsigned char>::robustPrune<CompareVectors<unsigned char>>(
-    const int&, 
-    std::set<int, CompareVectors<unsigned char>>&, 
-    const float, 
-    const int,
-    bool
-);
+// Explicit instantiation of ANN class and its searches for every datatype and metric.
+// Cosine normalizes the points, so it is only instantiated for float. The build searches with arena sets too.
+#define INSTANTIATE_ANN(datatype, Metric) \
+    template class ANN<datatype, Metric>; \
+    template void ANN<datatype, Metric>::filteredGreedySearch<CompareVectors<datatype, Metric>>( \
+        const int&, int, int, const float&, std::set<int, CompareVectors<datatype, Metric>>&, \
+        std::unordered_set<int>&, CompareVectors<datatype, Metric>&, SearchStats*); \
+    template void ANN<datatype, Metric>::rangeGreedySearch<CompareVectors<datatype, Metric>>( \
+        const int&, int, int, const float&, float, float, std::set<int, CompareVectors<datatype, Metric>>&, \
+        std::unordered_set<int>&, CompareVectors<datatype, Metric>&); \
+    template void ANN<datatype, Metric>::labelSetGreedySearch<CompareVectors<datatype, Metric>>( \
+        int, int, const std::vector<float>&, bool, std::set<int, CompareVectors<datatype, Metric>>&, \
+        std::unordered_set<int>&, CompareVectors<datatype, Metric>&); \
+    template void ANN<datatype, Metric>::greedySearch<CompareVectors<datatype, Metric>>( \
+        const int&, int, int, std::set<int, CompareVectors<datatype, Metric>>&, \
+        std::unordered_set<int>&, CompareVectors<datatype, Metric>&, SearchStats*); \
+    template void ANN<datatype, Metric>::batchGreedySearch<CompareVectors<datatype, Metric>>( \
+        const int&, int, int, std::vector<std::set<int, CompareVectors<datatype, Metric>>>&, \
+        std::vector<std::unordered_set<int>>&, std::vector<CompareVectors<datatype, Metric>>&); \
+    template void ANN<datatype, Metric>::robustPrune<CompareVectors<datatype, Metric>>( \
+        const int&, std::set<int, CompareVectors<datatype, Metric>>&, const float, const int, bool); \
+    template void ANN<datatype, Metric>::greedySearch<CompareVectors<datatype, Metric>>( \
+        const int&, int, int, ScratchSet<CompareVectors<datatype, Metric>>&, \
+        ScratchVisited&, CompareVectors<datatype, Metric>&, SearchStats*); \
+    template void ANN<datatype, Metric>::robustPrune<CompareVectors<datatype, Metric>>( \
+        const int&, ScratchSet<CompareVectors<datatype, Metric>>&, const float, const int, bool);
+
+INSTANTIATE_ANN(int, L2Metric)
+INSTANTIATE_ANN(float, L2Metric)
+INSTANTIATE_ANN(unsigned char, L2Metric)
+INSTANTIATE_ANN(int, InnerProductMetric)
+INSTANTIATE_ANN(float, InnerProductMetric)
+INSTANTIATE_ANN(unsigned char, InnerProductMetric)
+INSTANTIATE_ANN(float, CosineMetric)
@@ -1,6 +1,12 @@
 #include "graph.h"
+#include "profiler.h"
+#include "memory_usage.h"
 #include <random>
 
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
 Graph::Graph(std::size_t n, bool init_empty){
     // Randomly generate a graph with n nodes
     this->num_nodes = n;
@@ -112,35 +118,44 @@ void Graph::printGraph(){
     }
 }
 
-// If the graph is not regular, enforce it to be regular
-void Graph::enforceRegular(int R){
+// If the graph is not regular, enforce it to be regular. The nodes are split between threads if parallel is set.
+void Graph::enforceRegular(int R, bool parallel){
+    PROFILE_SCOPE("enforceRegular");
     
     size_t upper_limit = this->adj_list.size() <= static_cast<size_t>(R) ? this->adj_list.size()-1 : static_cast<size_t>(R);
     
-    // Thread safe random number generator
+    // Every thread has its own generator, seeded from the random device and its thread number, so the random
+    // edges are new on every run and the threads don't draw the same stream
     std::random_device rd;
-    std::mt19937 gen(rd());
-
-    #if defined(PARALLEL1)
-    #pragma omp parallel for private(gen)
-    #endif
-    for(std::size_t i = 0; i < this->adj_list.size(); i++){
-        std::unordered_set<int>& neighbours = this->getNeighbours(i);
-
-        // If node has more than R neighbors, remove random edges
-        if(neighbours.size() > static_cast<size_t>(R)){
-            std::vector<int> neighboursVec(neighbours.begin(), neighbours.end());
-            std::shuffle(neighboursVec.begin(), neighboursVec.end(), gen);
-            for(std::size_t j = R; j < neighboursVec.size(); ++j){
-                neighbours.erase(neighboursVec[j]);
+    const unsigned int seed = rd();
+
+    #pragma omp parallel if(parallel)
+    {
+        unsigned int thread = 0;
+#if defined(_OPENMP)
+        thread = (unsigned int)omp_get_thread_num();
+#endif
+        std::mt19937 gen(seed + thread);
+
+        #pragma omp for
+        for(std::size_t i = 0; i < this->adj_list.size(); i++){
+            std::unordered_set<int>& neighbours = this->getNeighbours(i);
+
+            // If node has more than R neighbors, remove random edges
+            if(neighbours.size() > static_cast<size_t>(R)){
+                std::vector<int> neighboursVec(neighbours.begin(), neighbours.end());
+                std::shuffle(neighboursVec.begin(), neighboursVec.end(), gen);
+                for(std::size_t j = R; j < neighboursVec.size(); ++j){
+                    neighbours.erase(neighboursVec[j]);
+                }
             }
-        }
-        
-        // If node has fewer than R neighbors, add random edges
-        while(neighbours.size() < upper_limit){
-            std::size_t j = gen() % this->adj_list.size();
-            if(i != j && neighbours.find(j) == neighbours.end()){
-                neighbours.insert(j);
+
+            // If node has fewer than R neighbors, add random edges
+            while(neighbours.size() < upper_limit){
+                std::size_t j = gen() % this->adj_list.size();
+                if(i != j && neighbours.find(j) == neighbours.end()){
+                    neighbours.insert(j);
+                }
             }
         }
     }
@@ -149,4 +164,35 @@ void Graph::enforceRegular(int R){
 
 std::size_t Graph::getNumberOfNodes(){
     return this->num_nodes;
-}
\ No newline at end of file
+}
+
+std::size_t Graph::memoryUsage() const{
+    std::size_t bytes = vectorBytes(this->adj_list);
+    for(const auto& neighbours : this->adj_list){
+        bytes += hashSetBytes(neighbours);
+    }
+    return bytes;
+}
+
+void Graph::permute(const std::vector<int>& new_id){
+    if(new_id.size() != this->num_nodes){
+        throw std::invalid_argument("permute: Size of the permutation does not match the graph");
+    }
+
+    // The sets are allocated again in the new order, so that the lists of close nodes are close in memory too
+    std::vector<int> order(this->num_nodes);
+    for(std::size_t i = 0; i < this->num_nodes; i++){
+        order[new_id[i]] = (int)i;
+    }
+
+    std::vector<std::unordered_set<int>> permuted(this->num_nodes);
+    for(std::size_t i = 0; i < this->num_nodes; i++){
+        const std::unordered_set<int>& old_neighbours = this->adj_list[order[i]];
+        permuted[i].reserve(old_neighbours.size());
+        for(int neighbour : old_neighbours){
+            permuted[i].insert(new_id[neighbour]);
+        }
+    }
+
+    this->adj_list.swap(permuted);
+}
@@ -0,0 +1,75 @@
+#include "latency.h"
+#include <algorithm>
+#include <cmath>
+
+std::size_t LatencyHistogram::bucketIndex(uint64_t value){
+    const uint64_t sub_buckets = 1ULL << LATENCY_SUB_BUCKET_BITS;
+    if(value < sub_buckets)
+        return value;
+
+    // Keep the highest LATENCY_SUB_BUCKET_BITS bits of the value, the top one is always set
+    int shift = 63 - __builtin_clzll(value) - (LATENCY_SUB_BUCKET_BITS - 1);
+    return (std::size_t)shift * (sub_buckets / 2) + (value >> shift);
+}
+
+uint64_t LatencyHistogram::bucketHighest(std::size_t index){
+    const uint64_t sub_buckets = 1ULL << LATENCY_SUB_BUCKET_BITS;
+    if(index < sub_buckets)
+        return index;
+
+    int shift = (int)(index / (sub_buckets / 2)) - 1;
+    uint64_t mantissa = index - (uint64_t)shift * (sub_buckets / 2);
+    return (mantissa << shift) + ((1ULL << shift) - 1);
+}
+
+void LatencyHistogram::record(uint64_t value){
+    std::size_t index = bucketIndex(value);
+    if(this->counts.size() <= index)
+        this->counts.resize(index + 1, 0);
+
+    this->counts[index]++;
+    this->total_count++;
+    this->max_value = std::max(this->max_value, value);
+    this->sum += (double)value;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other){
+    if(this->counts.size() < other.counts.size())
+        this->counts.resize(other.counts.size(), 0);
+
+    for(std::size_t i = 0; i < other.counts.size(); i++){
+        this->counts[i] += other.counts[i];
+    }
+    this->total_count += other.total_count;
+    this->max_value = std::max(this->max_value, other.max_value);
+    this->sum += other.sum;
+}
+
+uint64_t LatencyHistogram::percentile(double percentile) const{
+    if(this->total_count == 0)
+        return 0;
+
+    percentile = std::min(std::max(percentile, 0.0), 100.0);
+    uint64_t target = std::max<uint64_t>(1, (uint64_t)std::ceil(percentile / 100.0 * this->total_count));
+
+    uint64_t seen = 0;
+    for(std::size_t i = 0; i < this->counts.size(); i++){
+        seen += this->counts[i];
+        if(seen >= target)
+            return std::min(bucketHighest(i), this->max_value);
+    }
+
+    return this->max_value;
+}
+
+uint64_t LatencyHistogram::count() const{
+    return this->total_count;
+}
+
+uint64_t LatencyHistogram::max() const{
+    return this->max_value;
+}
+
+double LatencyHistogram::mean() const{
+    return this->total_count == 0 ? 0.0 : this->sum / this->total_count;
+}
@@ -3,9 +3,11 @@
 #include <map>
 #include <stdexcept>
 #include <set>
+#include <sstream>
 #include "defs.h"
 #include "utils_main.h"
 #include "ann.h"
+#include "profiler.h"
 
 void printHelp(){
     std::cout << GREEN << "Usage: " << std::endl << RESET 
@@ -22,6 +24,26 @@ void printHelp(){
               << "[" << YELLOW << "-algo " << MAGENTA << "<algorithm>" << RESET << "] "
               << "[" << YELLOW << "-query" << MAGENTA << "<y/n>" << RESET << "]"
               << "[" << YELLOW << "-log " << MAGENTA << "<file_path_log>" << RESET << "]"
+              << "[" << YELLOW << "-init " << MAGENTA << "<random/nndescent>" << RESET << "]"
+              << "[" << YELLOW << "-passes " << MAGENTA << "<alpha:L,...>" << RESET << "]"
+              << "[" << YELLOW << "-bridges " << MAGENTA << "<B>" << RESET << "]"
+              << "[" << YELLOW << "-threads " << MAGENTA << "<N>" << RESET << "]"
+              << "[" << YELLOW << "-parallel " << MAGENTA << "<serial/build/full>" << RESET << "]"
+              << "[" << YELLOW << "-medoid " << MAGENTA << "<random/exact>" << RESET << "]"
+              << "[" << YELLOW << "-precompute " << MAGENTA << "<none/build/search/all>" << RESET << "]"
+              << "[" << YELLOW << "-z " << MAGENTA << "<z>" << RESET << "]"
+              << "[" << YELLOW << "-bench " << MAGENTA << "<y/n>" << RESET << "]"
+              << "[" << YELLOW << "-workers " << MAGENTA << "<N>" << RESET << "]"
+              << "[" << YELLOW << "-rate " << MAGENTA << "<QPS>" << RESET << "]"
+              << "[" << YELLOW << "-batch " << MAGENTA << "<N>" << RESET << "]"
+              << "[" << YELLOW << "-sweep " << MAGENTA << "<file_path_csv>" << RESET << "]"
+              << "[" << YELLOW << "-sweepL " << MAGENTA << "<L,...>" << RESET << "]"
+              << "[" << YELLOW << "-sweepk " << MAGENTA << "<k,...>" << RESET << "]"
+              << "[" << YELLOW << "-profile " << MAGENTA << "<file_path_json>" << RESET << "]"
+              << "[" << YELLOW << "-perf " << MAGENTA << "<y/n>" << RESET << "]"
+              << "[" << YELLOW << "-memlog " << MAGENTA << "<file_path_csv>" << RESET << "]"
+              << "[" << YELLOW << "-reorder " << MAGENTA << "<none/bfs/rcm/gorder>" << RESET << "]"
+              << "[" << YELLOW << "-metric " << MAGENTA << "<l2/ip/cosine>" << RESET << "]"
               << std::endl << std::endl;
 
     std::cout << GREEN << "Options:" << RESET << std::endl;
@@ -48,7 +70,47 @@ void printHelp(){
     std::cout << "  -query " << "y/n "
               << ": (Optional) Flag to enable (y) or disable (n) query execution. Default is y. NOTE: This flag is overridden if a graph file is provided." << std::endl << std::endl;
     std::cout << "  -log " << "<file_path_log> "
-              << ": (Optional) Path to save the log file." << std::endl << std::endl;
+              << ": (Optional) Path to save the log file." << std::endl;
+    std::cout << "  -init " << "random/nndescent "
+              << ": (Optional) Starting graph of Vamana. Random edges or an approximate kNN graph from NN-Descent. Default is random." << std::endl;
+    std::cout << "  -passes " << "<alpha:L,...> "
+              << ": (Optional) Build the graph in passes, e.g. 1:100,1.2:150. Default is one pass with -a and -L." << std::endl;
+    std::cout << "  -bridges " << "<B> "
+              << ": (Optional) Add up to B edges per node between different filters, so that unfiltered queries start from the medoid. Use it with -load if the graph was saved with bridges. Default is 0." << std::endl;
+    std::cout << "  -threads " << "<N> "
+              << ": (Optional) Number of threads. Default is the OpenMP default." << std::endl;
+    std::cout << "  -parallel " << "serial/build/full "
+              << ": (Optional) Run everything serially, parallelize the build of the filters, NN-Descent, stitching and ground truth, or also the random edges and the exact medoid. Default is build." << std::endl;
+    std::cout << "  -medoid " << "random/exact "
+              << ": (Optional) Start node of Vamana. A random node or the exact medoid. Default is random." << std::endl;
+    std::cout << "  -precompute " << "none/build/search/all "
+              << ": (Optional) Compute the distances of every inserted point or query to all the points in parallel before the search. Default is build." << std::endl;
+    std::cout << "  -z " << "<z> "
+              << ": (Optional) Random edges of every node in the stitched graph. Default is R / 2." << std::endl;
+    std::cout << "  -bench " << "y/n "
+              << ": (Optional) Replay every query of the file and report the latency percentiles. Default is n." << std::endl;
+    std::cout << "  -workers " << "<N> "
+              << ": (Optional) Threads that run the queries of -bench. Default is 1." << std::endl;
+    std::cout << "  -rate " << "<QPS> "
+              << ": (Optional) Queries per second of -bench. The latency counts from the time a query arrives. Default is 0, which sends a query as soon as a worker is free." << std::endl;
+    std::cout << "  -batch " << "<N> "
+              << ": (Optional) Search N queries of a vector dataset together on one thread, switching to another query while the vectors of the next step of a query are loaded. The latency of a query is the time of its batch. Experimental, it was not faster than single queries on indexes that fit in the cache. Default is 1." << std::endl;
+    std::cout << "  -sweep " << "<file_path_csv> "
+              << ": (Optional) Run all the queries once for every L of -sweepL and k of -sweepk on the same graph and save recall@k, QPS and latency of every group of queries to a CSV." << std::endl;
+    std::cout << "  -sweepL " << "<L,...> "
+              << ": (Optional) Search list sizes of -sweep, e.g. 50,100,200. Default is -L." << std::endl;
+    std::cout << "  -sweepk " << "<k,...> "
+              << ": (Optional) Neighbours of -sweep, e.g. 1,10,100. Default is 10." << std::endl;
+    std::cout << "  -profile " << "<file_path_json> "
+              << ": (Optional) Time the phases of the build and save them as a Chrome trace for chrome://tracing or ui.perfetto.dev." << std::endl;
+    std::cout << "  -perf " << "<y/n> "
+              << ": (Optional) Add cycles, instructions and LLC misses of perf_event_open to every phase of -profile. Default is n." << std::endl;
+    std::cout << "  -memlog " << "<file_path_csv> "
+              << ": (Optional) Save the resident memory sampled every 100 ms during the build to a CSV." << std::endl;
+    std::cout << "  -reorder " << "none/bfs/rcm/gorder "
+              << ": (Optional) Give new ids to the nodes after the build, by a BFS from the medoid, Reverse Cuthill-McKee or Gorder, so that nodes that are searched together are close in memory. The order is saved with -save and used by -load. Default is none." << std::endl;
+    std::cout << "  -metric " << "l2/ip/cosine "
+              << ": (Optional) Distance of vector files. Squared L2, inner product for maximum inner product search, or cosine, which normalizes the vectors when they are loaded and needs fvecs. A computed ground truth is saved per metric. Default is l2." << std::endl << std::endl;
     std::cout << GREEN << "Example:" << RESET << std::endl;
     std::cout << CYAN << "  ./main -b base.bin -q query.bin -f bin -a 1.1 -R 10 -L 100 -query y" << RESET << std::endl;
 }
@@ -76,6 +138,49 @@ std::map<std::string, std::string> parseArguments(int argc, char** argv) {
     return args;
 }
 
+// Parse a list of positive integers in the form a,b,c
+std::vector<int> parseIntList(const std::string& value) {
+    std::vector<int> values;
+    std::stringstream stream(value);
+    std::string item;
+
+    while (std::getline(stream, item, ',')) {
+        int parsed = std::stoi(item);
+        if (parsed <= 0) {
+            throw std::invalid_argument("Invalid list value: " + item);
+        }
+        values.push_back(parsed);
+    }
+
+    if (values.empty()) {
+        throw std::invalid_argument("No values given");
+    }
+
+    return values;
+}
+
+// Parse a list of passes in the form alpha:L,alpha:L
+std::vector<VamanaPass> parsePasses(const std::string& value) {
+    std::vector<VamanaPass> passes;
+    std::stringstream stream(value);
+    std::string pass;
+
+    while (std::getline(stream, pass, ',')) {
+        std::size_t pos = pass.find(':');
+        if (pos == std::string::npos) {
+            throw std::invalid_argument("Invalid pass format: " + pass);
+        }
+
+        passes.push_back({std::stof(pass.substr(0, pos)), std::stoi(pass.substr(pos + 1))});
+    }
+
+    if (passes.empty()) {
+        throw std::invalid_argument("No passes given");
+    }
+
+    return passes;
+}
+
 void checkRequiredFlags(const std::map<std::string, std::string>& args, const std::set<std::string>& requiredFlags) {
     for (const auto& flag : requiredFlags) {
         if (args.find(flag) == args.end()) {
@@ -127,6 +232,135 @@ int main(int argc, char** argv) {
             }
         }
 
+        bool nn_descent = false;
+        if(args.find("-init") != args.end()){
+            std::string init_flag = args["-init"];
+            if(init_flag == "nndescent"){
+                nn_descent = true;
+            }
+            else if(init_flag != "random"){
+                throw std::invalid_argument("Invalid init flag");
+            }
+        }
+
+        std::vector<VamanaPass> passes;
+        if (args.find("-passes") != args.end()) {
+            passes = parsePasses(args["-passes"]);
+        }
+
+        int bridges = 0;
+        if (args.find("-bridges") != args.end()) {
+            bridges = std::stoi(args["-bridges"]);
+            if (bridges < 0) {
+                throw std::invalid_argument("Invalid bridges flag");
+            }
+        }
+
+        RuntimeConfig config;
+        if (args.find("-threads") != args.end()) {
+            config.threads = std::stoi(args["-threads"]);
+            if (config.threads < 0) {
+                throw std::invalid_argument("Invalid threads flag");
+            }
+            if (config.threads > 0) {
+                omp_set_num_threads(config.threads);
+            }
+        }
+
+        if (args.find("-parallel") != args.end()) {
+            config.parallel = parseParallelStrategy(args["-parallel"]);
+        }
+
+        if (args.find("-medoid") != args.end()) {
+            config.medoid = parseMedoidStrategy(args["-medoid"]);
+        }
+
+        if (args.find("-precompute") != args.end()) {
+            std::string precompute_flag = args["-precompute"];
+            if (precompute_flag != "none" && precompute_flag != "build" && precompute_flag != "search" && precompute_flag != "all") {
+                throw std::invalid_argument("Invalid precompute flag");
+            }
+            config.precompute_build = precompute_flag == "build" || precompute_flag == "all";
+            config.precompute_search = precompute_flag == "search" || precompute_flag == "all";
+        }
+
+        if (args.find("-z") != args.end()) {
+            config.stitch_random_edges = std::stoi(args["-z"]);
+            if (config.stitch_random_edges < 0) {
+                throw std::invalid_argument("Invalid z flag");
+            }
+        }
+
+        if (args.find("-bench") != args.end()) {
+            std::string bench_flag = args["-bench"];
+            if (bench_flag != "y" && bench_flag != "n") {
+                throw std::invalid_argument("Invalid bench flag");
+            }
+            config.benchmark = bench_flag == "y";
+        }
+
+        if (args.find("-workers") != args.end()) {
+            config.workers = std::stoi(args["-workers"]);
+            if (config.workers < 1) {
+                throw std::invalid_argument("Invalid workers flag");
+            }
+        }
+
+        if (args.find("-rate") != args.end()) {
+            config.arrival_rate = std::stod(args["-rate"]);
+            if (config.arrival_rate < 0) {
+                throw std::invalid_argument("Invalid rate flag");
+            }
+        }
+
+        if (args.find("-batch") != args.end()) {
+            config.search_batch = std::stoi(args["-batch"]);
+            if (config.search_batch < 1) {
+                throw std::invalid_argument("Invalid batch flag");
+            }
+        }
+
+        if (args.find("-sweep") != args.end()) {
+            config.sweep_file = args["-sweep"];
+            do_query = true;
+            config.sweep_L = { L };
+            if (args.find("-sweepL") != args.end()) {
+                config.sweep_L = parseIntList(args["-sweepL"]);
+            }
+            if (args.find("-sweepk") != args.end()) {
+                config.sweep_k = parseIntList(args["-sweepk"]);
+            }
+        }
+
+        if (args.find("-memlog") != args.end()) {
+            config.memory_log = args["-memlog"];
+        }
+
+        std::string metric = "l2";
+        if (args.find("-metric") != args.end()) {
+            metric = args["-metric"];
+            if (metric != "l2" && metric != "ip" && metric != "cosine") {
+                throw std::invalid_argument("Invalid metric flag");
+            }
+        }
+
+        if (args.find("-reorder") != args.end()) {
+            config.reorder = parseReorderStrategy(args["-reorder"]);
+        }
+
+        std::string file_path_profile = "";
+        bool profile_counters = false;
+        if (args.find("-profile") != args.end()) {
+            file_path_profile = args["-profile"];
+        }
+        if (args.find("-perf") != args.end()) {
+            std::string perf_flag = args["-perf"];
+            if (perf_flag != "y" && perf_flag != "n") {
+                throw std::invalid_argument("Invalid perf flag");
+            }
+            profile_counters = perf_flag == "y";
+        }
+
         // Check optional flags
         std::string file_path_gt = "";
         if (args.find("-gt") != args.end()) {
@@ -153,22 +387,41 @@ int main(int argc, char** argv) {
             throw std::invalid_argument("Invalid extension");
         }
 
+        if (!file_path_profile.empty()) {
+            Profiler::start(profile_counters);
+        }
+
+        // Vector files run with the metric of -metric, every metric is a separate instantiation of the index
+        auto process_vec = [&](auto datatype_value, auto metric_value){
+            processVecFormat<decltype(datatype_value), decltype(metric_value)>(file_path_base, file_path_query, file_path_gt,
+            alpha, R, L, file_path_load, file_path_save, do_query, file_path_log, nn_descent, passes, config);
+        };
+
+        // Cosine normalizes the vectors, so it needs float vectors
+        if (metric == "cosine" && file_format != "fvecs") {
+            throw std::invalid_argument("Cosine metric needs fvecs files");
+        }
+        if (metric != "l2" && file_format == "bin") {
+            throw std::invalid_argument("Bin files use the l2 metric");
+        }
+
         // Call processing function based on the file format
         if (file_format == "fvecs") {
-            processVecFormat<float>(file_path_base, file_path_query, file_path_gt,
-            alpha, R, L, file_path_load, file_path_save, do_query, file_path_log);
+            if (metric == "l2") process_vec(float(), L2Metric());
+            else if (metric == "ip") process_vec(float(), InnerProductMetric());
+            else process_vec(float(), CosineMetric());
         }
         else if (file_format == "ivecs") {
-            processVecFormat<int>(file_path_base, file_path_query, file_path_gt,
-            alpha, R, L, file_path_load, file_path_save, do_query, file_path_log);
+            if (metric == "l2") process_vec(int(), L2Metric());
+            else process_vec(int(), InnerProductMetric());
         }
         else if (file_format == "bvecs") {
-            processVecFormat<unsigned char>(file_path_base, file_path_query, file_path_gt, 
-            alpha, R, L, file_path_load, file_path_save, do_query, file_path_log);
+            if (metric == "l2") process_vec((unsigned char)0, L2Metric());
+            else process_vec((unsigned char)0, InnerProductMetric());
         }
         else if (file_format == "bin") {
             processBinFormat(file_path_base, file_path_query, file_path_gt,
-            alpha, R, L, file_path_load, file_path_save, args["-algo"], do_query, file_path_log);
+            alpha, R, L, file_path_load, file_path_save, args["-algo"], do_query, file_path_log, nn_descent, passes, bridges, config);
         }
         else {
             std::cerr << RED << "Error : Invalid extension" << RESET << std::endl;
@@ -176,6 +429,11 @@ int main(int argc, char** argv) {
             throw std::invalid_argument("Invalid extension");
         }
 
+        if (!file_path_profile.empty()) {
+            Profiler::printSummary();
+            Profiler::save(file_path_profile);
+        }
+
         std::cout << GREEN << "Processing completed successfully" << RESET << std::endl;
     }
     catch (const std::invalid_argument& e) {
@@ -0,0 +1,116 @@
+#include "memory_usage.h"
+#include "defs.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+static double megabytes(std::size_t bytes){
+    return (double)bytes / (1024.0 * 1024.0);
+}
+
+void MemoryReport::print() const{
+    std::ios_base::fmtflags flags = std::cout.flags();
+    std::streamsize precision = std::cout.precision();
+
+    std::size_t total = this->total();
+    std::cout << BLUE << "Index memory : " << RESET << std::fixed << std::setprecision(1) << megabytes(total) << " MB" << std::endl;
+    for(const auto& [name, bytes] : this->parts){
+        std::cout << "  " << std::left << std::setw(20) << name << std::right << std::setw(10) << megabytes(bytes) << " MB"
+                  << std::setw(8) << (total == 0 ? 0.0 : 100.0 * bytes / total) << "%" << std::endl;
+    }
+
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
+
+std::size_t currentRss(){
+    std::ifstream statm_file("/proc/self/statm");
+    std::size_t size = 0, resident = 0;
+    if(!(statm_file >> size >> resident))
+        return 0;
+
+    return resident * (std::size_t)sysconf(_SC_PAGESIZE);
+}
+
+std::size_t peakRss(){
+    std::ifstream status_file("/proc/self/status");
+    std::string line;
+
+    while(std::getline(status_file, line)){
+        if(line.find("VmHWM:") == 0){
+            std::istringstream iss(line);
+            std::string key;
+            std::size_t value;
+            iss >> key >> value;
+            return value * 1024;                            // Value is in KB
+        }
+    }
+
+    return 0;
+}
+
+RssSampler::~RssSampler(){
+    this->stop();
+}
+
+void RssSampler::start(int interval_ms){
+    this->stop();
+    this->samples.clear();
+    this->peak = 0;
+    this->running = true;
+
+    this->sampler = std::thread([this, interval_ms](){
+        auto begin = std::chrono::steady_clock::now();
+        while(true){
+            std::size_t rss = currentRss();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            {
+                std::lock_guard<std::mutex> lock(this->samples_mutex);
+                this->samples.push_back(std::make_pair(seconds, rss));
+                this->peak = std::max(this->peak, rss);
+            }
+
+            if(!this->running)
+                break;
+
+            // Sleep in short steps, so that stop doesn't wait for a whole interval
+            for(int slept = 0; slept < interval_ms && this->running; slept += 10){
+                std::this_thread::sleep_for(std::chrono::milliseconds(std::min(10, interval_ms - slept)));
+            }
+        }
+    });
+}
+
+void RssSampler::stop(){
+    this->running = false;
+    if(this->sampler.joinable())
+        this->sampler.join();
+}
+
+std::size_t RssSampler::peakBytes(){
+    std::lock_guard<std::mutex> lock(this->samples_mutex);
+    return this->peak;
+}
+
+std::vector<std::pair<double, std::size_t>> RssSampler::getSamples(){
+    std::lock_guard<std::mutex> lock(this->samples_mutex);
+    return this->samples;
+}
+
+void RssSampler::save(const std::string& file_path){
+    std::ofstream file(file_path);
+    if(!file){
+        throw std::runtime_error("Could not open file to save memory samples");
+    }
+
+    file << "seconds,rss_mb" << std::endl;
+    file << std::fixed << std::setprecision(3);
+    for(const auto& [seconds, bytes] : this->getSamples()){
+        file << seconds << ',' << megabytes(bytes) << std::endl;
+    }
+    file.close();
+}
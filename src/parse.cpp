@@ -1,6 +1,6 @@
 #include "parse.h"
 
-void parseDataVector(const std::string& path, std::vector<float>& vec_with_category_values, std::vector<std::vector<float>>& vec_with_points){
+void parseDataVector(const std::string& path, std::vector<float>& vec_with_category_values, std::vector<float>& vec_with_timestamps, std::vector<std::vector<float>>& vec_with_points){
     std::ifstream file(path, std::ios::binary);
 
     if(!file){
@@ -12,14 +12,15 @@ void parseDataVector(const std::string& path, std::vector<float>& vec_with_categ
 
     // Preallocate memory for the vectors, because we know the size
     vec_with_category_values.resize(num_points);
+    vec_with_timestamps.resize(num_points);
     vec_with_points.resize(num_points, std::vector<float>(100));
 
     for(u_int32_t i = 0; i < num_points; i++){
         // Categorical filter
         file.read((char*)&vec_with_category_values[i], sizeof(float));
 
-        // Skip the 4 bytes used for timestamp
-        file.seekg(4, std::ios::cur);
+        // Timestamp
+        file.read((char*)&vec_with_timestamps[i], sizeof(float));
 
         // Read the 100 dimension float vector
         file.read((char*)vec_with_points[i].data(), 100 * sizeof(float));
@@ -28,7 +29,7 @@ void parseDataVector(const std::string& path, std::vector<float>& vec_with_categ
     file.close();
 }
 
-void parseQueryVector(const std::string& path, std::vector<float>& query_filters, std::vector<std::vector<float>>& query_points){
+void parseQueryVector(const std::string& path, std::vector<int>& query_types, std::vector<float>& query_filters, std::vector<std::pair<float, float>>& query_ranges, std::vector<std::vector<float>>& query_points){
     std::ifstream file(path, std::ios::binary);
 
     if(!file){
@@ -38,26 +39,24 @@ void parseQueryVector(const std::string& path, std::vector<float>& query_filters
     u_int32_t num_queries;
     file.read((char*)&num_queries, sizeof(u_int32_t));
 
-    // We don't want to keep all the points because we don't care about timestamps queries.
-    // So we don't care for query_id 2 and 3. That's why we don't preallocate memory for the points.
+    // Preallocate memory for the vectors, because we know the size
+    query_types.resize(num_queries);
+    query_filters.resize(num_queries);
+    query_ranges.resize(num_queries);
+    query_points.resize(num_queries, std::vector<float>(100));
+
     for(u_int32_t i = 0; i < num_queries; i++){
-        float query_id;
-        float category_value;
+        float query_type;
+        file.read((char*)&query_type, sizeof(float));
+        query_types[i] = (int)query_type;
 
-        // Read first 8 bytes and then skip the next 8 bytes
-        file.read((char*)&query_id, sizeof(float));
-        file.read((char*)&category_value, sizeof(float));
-        file.seekg(2 * sizeof(float), std::ios::cur);
+        // Filter value and the range of the timestamps
+        file.read((char*)&query_filters[i], sizeof(float));
+        file.read((char*)&query_ranges[i].first, sizeof(float));
+        file.read((char*)&query_ranges[i].second, sizeof(float));
 
         // Read the 100 dimension float vector
-        std::vector<float> point(100);
-        file.read((char*)point.data(), 100 * sizeof(float));
-
-        // Use std::move to avoid copying the vector
-        if(query_id == 0 || query_id == 1){
-            query_filters.push_back(category_value);
-            query_points.push_back(std::move(point));
-        }
+        file.read((char*)query_points[i].data(), 100 * sizeof(float));
     }
 
     file.close();
@@ -0,0 +1,268 @@
+#include "profiler.h"
+#include "defs.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const char* const PHASE_NAMES[(int)ProfilePhase::Count] = {"greedy", "prune", "reverse"};
+
+struct ProfileEvent{
+    const char* name;
+    double start_us;
+    double duration_us;
+    ProfileCounters counters;
+    ProfileTotals phases[(int)ProfilePhase::Count];          // Phase totals of the thread during the event
+};
+
+// Events, phase totals and perf_event_open group of one thread
+struct ProfileThread{
+    int tid;
+    int counter_fds[3] = {-1, -1, -1};                      // Cycles is the leader of the group
+    std::vector<ProfileEvent> events;
+    ProfileTotals phases[(int)ProfilePhase::Count];
+
+    ~ProfileThread(){
+        for(int fd : this->counter_fds){
+            if(fd >= 0)
+                close(fd);
+        }
+    }
+};
+
+static std::mutex profile_mutex;
+static std::vector<std::unique_ptr<ProfileThread>> profile_threads;
+static std::chrono::steady_clock::time_point profile_origin;
+static bool profile_hardware = false;
+static std::atomic<bool> profile_counters_failed(false);
+static uint64_t profile_generation = 0;                    // Changes on every start, so that threads register again
+
+static thread_local ProfileThread* current_thread = nullptr;
+static thread_local uint64_t current_generation = 0;
+
+static int openCounter(uint64_t config, int group){
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = group == -1 ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    // pid 0 and cpu -1 count the calling thread on any cpu
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void openCounters(ProfileThread& thread){
+    static const uint64_t configs[3] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+    for(int i = 0; i < 3; i++){
+        thread.counter_fds[i] = openCounter(configs[i], i == 0 ? -1 : thread.counter_fds[0]);
+        if(thread.counter_fds[i] < 0){
+            // Usually perf_event_paranoid or a container without the events, the timers still work
+            if(!profile_counters_failed){
+                std::cerr << YELLOW << "Warning : perf_event_open failed (" << std::strerror(errno) << "), the profile has no hardware counters" << RESET << std::endl;
+                profile_counters_failed = true;
+            }
+            for(int& fd : thread.counter_fds){
+                if(fd >= 0)
+                    close(fd);
+                fd = -1;
+            }
+            return;
+        }
+    }
+
+    ioctl(thread.counter_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(thread.counter_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+static ProfileThread& threadState(){
+    if(current_thread == nullptr || current_generation != profile_generation){
+        std::lock_guard<std::mutex> lock(profile_mutex);
+        profile_threads.push_back(std::make_unique<ProfileThread>());
+        current_thread = profile_threads.back().get();
+        current_thread->tid = (int)profile_threads.size() - 1;
+        current_generation = profile_generation;
+        if(profile_hardware && !profile_counters_failed)
+            openCounters(*current_thread);
+    }
+    return *current_thread;
+}
+
+static ProfileCounters difference(const ProfileCounters& after, const ProfileCounters& before){
+    ProfileCounters result;
+    result.cycles = after.cycles - before.cycles;
+    result.instructions = after.instructions - before.instructions;
+    result.llc_misses = after.llc_misses - before.llc_misses;
+    return result;
+}
+
+static void add(ProfileCounters& total, const ProfileCounters& counters){
+    total.cycles += counters.cycles;
+    total.instructions += counters.instructions;
+    total.llc_misses += counters.llc_misses;
+}
+
+void Profiler::start(bool hardware_counters){
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    profile_threads.clear();
+    profile_generation++;
+    profile_hardware = hardware_counters;
+    profile_counters_failed = false;
+    profile_origin = std::chrono::steady_clock::now();
+    active = true;
+}
+
+void Profiler::stop(){
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    active = false;
+    profile_threads.clear();
+    profile_generation++;
+}
+
+bool Profiler::hardwareCounters(){
+    return profile_hardware && !profile_counters_failed;
+}
+
+double Profiler::now(){
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - profile_origin).count();
+}
+
+ProfileCounters Profiler::readCounters(){
+    ProfileCounters counters;
+    ProfileThread& thread = threadState();
+    if(thread.counter_fds[0] < 0)
+        return counters;
+
+    // With PERF_FORMAT_GROUP the leader returns the number of events and then their values
+    uint64_t values[4] = {0, 0, 0, 0};
+    if(read(thread.counter_fds[0], values, sizeof(values)) == (ssize_t)sizeof(values)){
+        counters.cycles = values[1];
+        counters.instructions = values[2];
+        counters.llc_misses = values[3];
+    }
+    return counters;
+}
+
+void Profiler::addEvent(const char* name, double start_us, double duration_us, const ProfileCounters& counters, const ProfileTotals* phases_before){
+    ProfileThread& thread = threadState();
+
+    ProfileEvent event;
+    event.name = name;
+    event.start_us = start_us;
+    event.duration_us = duration_us;
+    event.counters = difference(readCounters(), counters);
+    for(int i = 0; i < (int)ProfilePhase::Count; i++){
+        event.phases[i].calls = thread.phases[i].calls - phases_before[i].calls;
+        event.phases[i].time_us = thread.phases[i].time_us - phases_before[i].time_us;
+        event.phases[i].counters = difference(thread.phases[i].counters, phases_before[i].counters);
+    }
+    thread.events.push_back(event);
+}
+
+void Profiler::addPhase(ProfilePhase phase, double duration_us, const ProfileCounters& counters){
+    ProfileTotals& totals = threadState().phases[(int)phase];
+    totals.calls++;
+    totals.time_us += duration_us;
+    add(totals.counters, difference(readCounters(), counters));
+}
+
+void Profiler::threadPhases(ProfileTotals* phases){
+    ProfileThread& thread = threadState();
+    for(int i = 0; i < (int)ProfilePhase::Count; i++){
+        phases[i] = thread.phases[i];
+    }
+}
+
+ProfileTotals Profiler::phaseTotals(ProfilePhase phase){
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    ProfileTotals result;
+    for(const auto& thread : profile_threads){
+        const ProfileTotals& totals = thread->phases[(int)phase];
+        result.calls += totals.calls;
+        result.time_us += totals.time_us;
+        add(result.counters, totals.counters);
+    }
+    return result;
+}
+
+static void writeCounters(std::ofstream& file, const ProfileCounters& counters, const char* prefix){
+    file << ",\"" << prefix << "cycles\":" << counters.cycles
+         << ",\"" << prefix << "instructions\":" << counters.instructions
+         << ",\"" << prefix << "llc_misses\":" << counters.llc_misses;
+}
+
+// Chrome trace in the JSON object format: a complete event ("X") for every scope and the name of every thread
+void Profiler::save(const std::string& file_path){
+    std::ofstream file(file_path);
+    if(!file){
+        throw std::runtime_error("Could not open file to save profile");
+    }
+
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    bool hardware = profile_hardware && !profile_counters_failed;
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    bool first = true;
+    for(const auto& thread : profile_threads){
+        file << (first ? "" : ",") << std::endl
+             << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << thread->tid
+             << ",\"args\":{\"name\":\"" << (thread->tid == 0 ? "main" : "worker " + std::to_string(thread->tid)) << "\"}}";
+        first = false;
+
+        for(const auto& event : thread->events){
+            file << "," << std::endl
+                 << "{\"name\":\"" << event.name << "\",\"cat\":\"build\",\"ph\":\"X\",\"pid\":0,\"tid\":" << thread->tid
+                 << ",\"ts\":" << event.start_us << ",\"dur\":" << event.duration_us << ",\"args\":{";
+
+            file << "\"thread_ms\":" << event.duration_us / 1e3;
+            if(hardware)
+                writeCounters(file, event.counters, "");
+
+            // Phases that ran on this thread during the event
+            for(int i = 0; i < (int)ProfilePhase::Count; i++){
+                const ProfileTotals& phase = event.phases[i];
+                if(phase.calls == 0)
+                    continue;
+
+                std::string prefix = std::string(PHASE_NAMES[i]) + "_";
+                file << ",\"" << prefix << "calls\":" << phase.calls << ",\"" << prefix << "ms\":" << phase.time_us / 1e3;
+                if(hardware)
+                    writeCounters(file, phase.counters, prefix.c_str());
+            }
+            file << "}}";
+        }
+    }
+    file << std::endl << "]}" << std::endl;
+    file.close();
+
+    std::cout << GREEN << "Profile saved to " << file_path << RESET << std::endl;
+}
+
+void Profiler::printSummary(){
+    std::ios_base::fmtflags flags = std::cout.flags();
+    std::cout << BLUE << "Build phases (all threads)" << RESET << std::endl;
+    for(int i = 0; i < (int)ProfilePhase::Count; i++){
+        ProfileTotals totals = phaseTotals((ProfilePhase)i);
+        std::cout << "  " << std::left << std::setw(10) << PHASE_NAMES[i] << std::right
+                  << totals.calls << " calls, " << totals.time_us / 1e3 << " ms";
+        if(hardwareCounters() && totals.counters.cycles > 0){
+            std::cout << ", " << (double)totals.counters.instructions / totals.counters.cycles << " IPC, "
+                      << totals.counters.llc_misses << " LLC misses";
+        }
+        std::cout << std::endl;
+    }
+    std::cout.flags(flags);
+}
@@ -0,0 +1,274 @@
+#include "reorder.h"
+#include "defs.h"
+#include <numeric>
+
+// In-neighbours of node i are sources[offsets[i]..offsets[i+1])
+static void inEdges(Graph& G, std::vector<int>& offsets, std::vector<int>& sources){
+    std::size_t n = G.getNumberOfNodes();
+    offsets.assign(n + 1, 0);
+    for(std::size_t i = 0; i < n; i++){
+        for(int neighbour : G.getNeighbours(i)){
+            offsets[neighbour + 1]++;
+        }
+    }
+
+    for(std::size_t i = 0; i < n; i++){
+        offsets[i + 1] += offsets[i];
+    }
+
+    std::vector<int> position(offsets.begin(), offsets.end() - 1);
+    sources.resize(offsets[n]);
+    for(std::size_t i = 0; i < n; i++){
+        for(int neighbour : G.getNeighbours(i)){
+            sources[position[neighbour]++] = (int)i;
+        }
+    }
+}
+
+std::vector<int> bfsOrder(Graph& G, int start){
+    return bfsOrder(G, std::vector<int>{start});
+}
+
+std::vector<int> bfsOrder(Graph& G, const std::vector<int>& starts){
+    std::size_t n = G.getNumberOfNodes();
+    for(int start : starts){
+        if(start < 0 || (std::size_t)start >= n){
+            std::cerr << "Error : Start node of the BFS order is out of range" << RESET << std::endl;
+            throw std::invalid_argument("bfsOrder: Start node out of range");
+        }
+    }
+
+    std::vector<int> order;
+    order.reserve(n);
+    std::vector<bool> visited(n, false);
+
+    // The order itself is the queue of the search. The roots are the start nodes and then the smallest unvisited ids.
+    std::size_t next_start = 0;
+    std::size_t next_unvisited = 0;
+    while(true){
+        int root = -1;
+        while(next_start < starts.size() && root == -1){
+            if(!visited[starts[next_start]])
+                root = starts[next_start];
+            next_start++;
+        }
+        if(root == -1){
+            while(next_unvisited < n && visited[next_unvisited]){
+                next_unvisited++;
+            }
+            if(next_unvisited == n)
+                break;
+            root = (int)next_unvisited;
+        }
+
+        std::size_t head = order.size();
+        visited[root] = true;
+        order.push_back(root);
+
+        while(head < order.size()){
+            int node = order[head++];
+            for(int neighbour : G.getNeighbours(node)){
+                if(!visited[neighbour]){
+                    visited[neighbour] = true;
+                    order.push_back(neighbour);
+                }
+            }
+        }
+    }
+
+    return order;
+}
+
+std::vector<int> rcmOrder(Graph& G){
+    std::size_t n = G.getNumberOfNodes();
+    std::vector<int> in_offsets, in_sources;
+    inEdges(G, in_offsets, in_sources);
+
+    std::vector<int> degree(n);
+    for(std::size_t i = 0; i < n; i++){
+        degree[i] = G.countNeighbours(i) + in_offsets[i + 1] - in_offsets[i];
+    }
+
+    // Components start from their node with the smallest degree
+    std::vector<int> roots(n);
+    std::iota(roots.begin(), roots.end(), 0);
+    std::stable_sort(roots.begin(), roots.end(), [&](int a, int b){ return degree[a] < degree[b]; });
+
+    std::vector<int> order;
+    order.reserve(n);
+    std::vector<bool> visited(n, false);
+    std::vector<int> neighbours;
+
+    for(int root : roots){
+        if(visited[root])
+            continue;
+
+        std::size_t head = order.size();
+        visited[root] = true;
+        order.push_back(root);
+
+        while(head < order.size()){
+            int node = order[head++];
+
+            // Out and in neighbours, as the edges of the symmetric graph
+            neighbours.clear();
+            for(int neighbour : G.getNeighbours(node)){
+                if(!visited[neighbour])
+                    neighbours.push_back(neighbour);
+            }
+            for(int j = in_offsets[node]; j < in_offsets[node + 1]; j++){
+                if(!visited[in_sources[j]])
+                    neighbours.push_back(in_sources[j]);
+            }
+
+            std::sort(neighbours.begin(), neighbours.end(), [&](int a, int b){
+                return degree[a] < degree[b] || (degree[a] == degree[b] && a < b);
+            });
+            for(int neighbour : neighbours){
+                if(!visited[neighbour]){
+                    visited[neighbour] = true;
+                    order.push_back(neighbour);
+                }
+            }
+        }
+    }
+
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+// Nodes in buckets of the same score, kept as doubly linked lists, so that a score changes by one in O(1)
+// and the node with the highest score is found by walking down from the highest bucket
+class UnitHeap{
+private:
+    std::vector<int> score;
+    std::vector<int> prev;
+    std::vector<int> next;
+    std::vector<int> head;                                  // First node of every score, -1 if there is none
+    std::vector<bool> removed;
+    int top = 0;
+
+    void unlink(int node){
+        if(this->prev[node] != -1)
+            this->next[this->prev[node]] = this->next[node];
+        else
+            this->head[this->score[node]] = this->next[node];
+        if(this->next[node] != -1)
+            this->prev[this->next[node]] = this->prev[node];
+    }
+
+    void link(int node){
+        if((std::size_t)this->score[node] >= this->head.size())
+            this->head.resize(this->score[node] + 1, -1);
+
+        this->prev[node] = -1;
+        this->next[node] = this->head[this->score[node]];
+        if(this->next[node] != -1)
+            this->prev[this->next[node]] = node;
+        this->head[this->score[node]] = node;
+        this->top = std::max(this->top, this->score[node]);
+    }
+
+public:
+    // All the nodes start with score 0 and the smallest id first
+    UnitHeap(std::size_t n) : score(n, 0), prev(n, -1), next(n, -1), head(1, -1), removed(n, false){
+        for(std::size_t i = n; i-- > 0;){
+            this->link((int)i);
+        }
+    }
+
+    void change(int node, int delta){
+        if(this->removed[node])
+            return;
+
+        this->unlink(node);
+        this->score[node] += delta;
+        this->link(node);
+    }
+
+    void remove(int node){
+        if(this->removed[node])
+            return;
+
+        this->unlink(node);
+        this->removed[node] = true;
+    }
+
+    int popMax(){
+        while(this->top > 0 && this->head[this->top] == -1){
+            this->top--;
+        }
+
+        int node = this->head[this->top];
+        if(node != -1)
+            this->remove(node);
+        return node;
+    }
+};
+
+std::vector<int> gorderOrder(Graph& G, int window){
+    std::size_t n = G.getNumberOfNodes();
+    if(window < 1){
+        std::cerr << "Error : Window of Gorder must be positive" << RESET << std::endl;
+        throw std::invalid_argument("gorderOrder: Window must be positive");
+    }
+
+    std::vector<int> order;
+    if(n == 0)
+        return order;
+    order.reserve(n);
+
+    std::vector<int> in_offsets, in_sources;
+    inEdges(G, in_offsets, in_sources);
+
+    // The score of a candidate is its edges to the nodes of the window and the in-neighbours it shares with them.
+    // A node adds to the scores when it enters the window and takes the same amount back when it leaves.
+    UnitHeap heap(n);
+    auto update = [&](int node, int delta){
+        for(int neighbour : G.getNeighbours(node)){
+            heap.change(neighbour, delta);
+        }
+        for(int j = in_offsets[node]; j < in_offsets[node + 1]; j++){
+            int source = in_sources[j];
+            heap.change(source, delta);
+            for(int sibling : G.getNeighbours(source)){
+                if(sibling != node)
+                    heap.change(sibling, delta);
+            }
+        }
+    };
+
+    // Start from the node with the most in-neighbours
+    int start = 0;
+    for(std::size_t i = 1; i < n; i++){
+        if(in_offsets[i + 1] - in_offsets[i] > in_offsets[start + 1] - in_offsets[start])
+            start = (int)i;
+    }
+
+    heap.remove(start);
+    order.push_back(start);
+    update(start, 1);
+
+    while(order.size() < n){
+        if(order.size() > (std::size_t)window)
+            update(order[order.size() - window - 1], -1);
+
+        int node = heap.popMax();
+        order.push_back(node);
+        update(node, 1);
+    }
+
+    return order;
+}
+
+std::vector<int> inverseOrder(const std::vector<int>& order){
+    std::vector<int> new_id(order.size(), -1);
+    for(std::size_t i = 0; i < order.size(); i++){
+        if(order[i] < 0 || (std::size_t)order[i] >= order.size() || new_id[order[i]] != -1){
+            std::cerr << "Error : Order is not a permutation of the nodes" << RESET << std::endl;
+            throw std::invalid_argument("inverseOrder: Order is not a permutation");
+        }
+        new_id[order[i]] = (int)i;
+    }
+    return new_id;
+}
@@ -0,0 +1,82 @@
+#include "scratch.h"
+#include <algorithm>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+void* ScratchArena::Counter::do_allocate(std::size_t bytes, std::size_t alignment){
+    this->bytes += bytes + alignment - 1;
+    return this->next->allocate(bytes, alignment);
+}
+
+void ScratchArena::Counter::do_deallocate(void* p, std::size_t bytes, std::size_t alignment){
+    this->next->deallocate(p, bytes, alignment);
+}
+
+bool ScratchArena::Counter::do_is_equal(const std::pmr::memory_resource& other) const noexcept{
+    return this == &other;
+}
+
+ScratchArena::ScratchArena(std::size_t bytes){
+    this->overflow.next = std::pmr::new_delete_resource();
+    this->rebuild(bytes);
+}
+
+// New buffer of the given size, an empty one takes all its memory from the heap
+void ScratchArena::rebuild(std::size_t bytes){
+    this->resource.reset();
+    this->buffer = std::vector<std::byte>(bytes);
+    if(bytes == 0)
+        this->resource.emplace(&this->overflow);
+    else
+        this->resource.emplace(this->buffer.data(), this->buffer.size(), &this->overflow);
+
+    this->used.next = &this->resource.value();
+    this->used.bytes = 0;
+    this->overflow.bytes = 0;
+}
+
+std::pmr::memory_resource* ScratchArena::get(){
+    return &this->used;
+}
+
+void ScratchArena::reset(){
+    this->resource->release();
+    if(this->overflow.bytes == 0){
+        this->used.bytes = 0;
+        return;
+    }
+
+    // The last insertion didn't fit, so the buffer takes the memory that it used
+    this->rebuild(std::max(this->buffer.size(), this->used.bytes));
+}
+
+std::size_t ScratchArena::release(){
+    std::size_t bytes = std::max(this->buffer.size(), this->used.bytes);
+    this->resource->release();
+    this->rebuild(0);
+    return bytes;
+}
+
+std::size_t ScratchArena::capacity() const{
+    return this->buffer.size();
+}
+
+ScratchArena& ScratchArena::local(){
+    thread_local ScratchArena arena;
+    return arena;
+}
+
+std::size_t ScratchArena::releaseAll([[maybe_unused]] int threads){
+    std::size_t largest = ScratchArena::local().release();
+
+#if defined(_OPENMP)
+    if(!omp_in_parallel()){
+        #pragma omp parallel num_threads(threads) reduction(max : largest)
+        largest = std::max(largest, ScratchArena::local().release());
+    }
+#endif
+
+    return largest;
+}
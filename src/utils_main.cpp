@@ -1,26 +1,58 @@
 #include "utils_main.h"
 #include "ann.h"
+#include "task_pool.h"
+#include "latency.h"
+#include "profiler.h"
+#include "memory_usage.h"
+#include "reorder.h"
+#include <atomic>
+#include <exception>
+#include <thread>
 #include <iomanip>
+#include <limits>
 #include <filesystem>
 #include <sys/resource.h>
 #include <sys/time.h>
 
-long getPeakMemoryUsage() {
-    std::ifstream status_file("/proc/self/status");
-    std::string line;
-
-    while(std::getline(status_file, line)){
-        if(line.find("VmPeak:") == 0){
-            std::istringstream iss(line);
-            std::string key;
-            long value;
-            std::string unit;
-            iss >> key >> value >> unit;
-            return value; // Value is in KB
-        }
+// Stop the sampler, print the memory of every part of the index and the peak resident memory of the build.
+// Returns the memory of the index in KB for the log.
+template <typename datatype, typename Metric>
+static long reportBuildMemory(ANN<datatype, Metric>& ann, RssSampler& sampler, const RuntimeConfig& config){
+    sampler.stop();
+
+    MemoryReport report = ann.memoryUsage();
+    report.print();
+    std::cout << BLUE << "Peak RSS during build : " << RESET << sampler.peakBytes() / (1024 * 1024) << " MB" << std::endl;
+
+    if(!config.memory_log.empty()){
+        sampler.save(config.memory_log);
+        std::cout << GREEN << "Memory samples saved to " << config.memory_log << RESET << std::endl;
     }
 
-    return 0;
+    return (long)(report.total() / 1024);
+}
+
+// Reorder a built index with the strategy of the config, a loaded one has the order of its file already.
+// The ground truth has the ids of the input, so it is translated to the ids of the index.
+template <typename datatype, typename Metric>
+static void reorderIndex(ANN<datatype, Metric>& ann, std::vector<std::vector<int>>& gt, bool built, const RuntimeConfig& config){
+    if(built && config.reorder != ReorderStrategy::None){
+        auto start = std::chrono::high_resolution_clock::now();
+        ann.reorder(config.reorder);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << GREEN << "Graph reordered in " << std::chrono::duration<double>(end - start).count() << " s" << RESET << std::endl;
+    }
+
+    if(ann.node_to_original.empty())
+        return;
+
+    std::vector<int> new_id = inverseOrder(ann.node_to_original);
+    for(auto& neighbours : gt){
+        for(int& id : neighbours){
+            if(id >= 0 && (std::size_t)id < new_id.size())
+                id = new_id[id];
+        }
+    }
 }
 
 std::string findExtension(const std::string& file_path){
@@ -80,63 +112,326 @@ bool validateExtension(const std::string& file_path_base, const std::string& fil
     return true;
 }
 
+// Percentiles and histogram of one counter over all the queries
+static void printCounter(const std::string& counter, std::vector<double> values){
+    std::sort(values.begin(), values.end());
+    std::size_t n = values.size();
+    auto percentile = [&](double p){ return values[std::min(n - 1, (std::size_t)(p * n))]; };
+    double mean = std::accumulate(values.begin(), values.end(), 0.0) / n;
+    std::streamsize precision = std::cout.precision();
+
+    std::cout << "  " << std::left << std::setw(12) << counter << std::right << std::fixed << std::setprecision(1)
+              << " mean " << std::setw(10) << mean
+              << " p50 " << std::setw(10) << percentile(0.5)
+              << " p90 " << std::setw(10) << percentile(0.9)
+              << " p99 " << std::setw(10) << percentile(0.99)
+              << " max " << std::setw(10) << values.back() << std::endl;
+
+    // Bucket b has the values in [2^(b-1), 2^b), bucket 0 has the zeros
+    std::vector<std::size_t> buckets;
+    for(double value : values){
+        std::size_t bucket = 0;
+        while(bucket < 64 && value >= (double)(1ULL << bucket))
+            bucket++;
+        if(buckets.size() <= bucket)
+            buckets.resize(bucket + 1, 0);
+        buckets[bucket]++;
+    }
+
+    std::size_t most = *std::max_element(buckets.begin(), buckets.end());
+    for(std::size_t bucket = 0; bucket < buckets.size(); bucket++){
+        if(buckets[bucket] == 0)
+            continue;
+
+        std::size_t low = bucket == 0 ? 0 : 1ULL << (bucket - 1);
+        std::cout << "    [" << std::setw(8) << low << ", " << std::setw(8) << (1ULL << bucket) << ") "
+                  << std::setw(6) << buckets[bucket] << " " << std::string(buckets[bucket] * 40 / most, '#') << std::endl;
+    }
+    std::cout << std::defaultfloat << std::setprecision(precision);
+}
+
+void printSearchStats(const std::string& name, const std::vector<SearchStats>& stats){
+    if(stats.empty())
+        return;
+
+    // Queries that didn't search, e.g. a filter without a start node, keep empty counters and are only counted
+    std::vector<double> expansions, distances, prunes, visited, time_us;
+    std::size_t skipped = 0;
+    for(const SearchStats& query_stats : stats){
+        if(query_stats.visited == 0){
+            skipped++;
+            continue;
+        }
+        expansions.push_back(query_stats.expansions);
+        distances.push_back(query_stats.distances);
+        prunes.push_back(query_stats.prunes);
+        visited.push_back(query_stats.visited);
+        time_us.push_back(query_stats.time_us);
+    }
+
+    std::cout << BLUE << "Search statistics for " << name << " (" << stats.size() - skipped << " queries, " << skipped << " skipped)" << RESET << std::endl;
+    if(expansions.empty())
+        return;
+
+    printCounter("expansions", expansions);
+    printCounter("distances", distances);
+    printCounter("prunes", prunes);
+    printCounter("visited", visited);
+    printCounter("time (us)", time_us);
+}
+
 // Function that calculates the ground truth vectors for the queries
-template <typename datatype>
+template <typename datatype, typename Metric>
 void calculateGroundTruth(const std::vector<std::vector<datatype>>& queries, 
                             const std::vector<std::vector<datatype>>& base_points,
                             std::vector<std::vector<std::pair<float, int>>>& ground_truth,
                             const std::vector<float>* query_category_values,
-                            const std::vector<float>* base_category_values){
+                            const std::vector<float>* base_category_values,
+                            const std::vector<std::pair<float, float>>* query_ranges,
+                            const std::vector<float>* base_timestamps,
+                            const RuntimeConfig& config){
+
+    PROFILE_SCOPE("calculateGroundTruth");
 
     // Preallocate memory
     ground_truth.clear();
     ground_truth.resize(queries.size());
 
     std::size_t n = queries.size();
+
+    // A metric of normalized vectors is the sum of the products of the coordinates, so every sum is scaled by
+    // the inverse norms instead of keeping a normalized copy of the base
+    std::vector<double> inverse_norms;
+    if constexpr(Metric::normalized){
+        inverse_norms.resize(base_points.size());
+        for(std::size_t j = 0; j < base_points.size(); j++){
+            double norm = 0.0;
+            for(datatype coordinate : base_points[j]){
+                norm += (double)coordinate * coordinate;
+            }
+            inverse_norms[j] = norm == 0.0 ? 0.0 : 1.0 / std::sqrt(norm);
+        }
+    }
     
-    #pragma omp parallel for
-    for(std::size_t i = 0; i < n; i++){
-        const auto& query = queries[i];
+    parallelFor(n, 1, [&](std::size_t i){
+        std::vector<datatype> normalized_query;
+        if constexpr(Metric::normalized){
+            normalized_query = queries[i];
+            normalizeVector(normalized_query);
+        }
+        const auto& query = Metric::normalized ? normalized_query : queries[i];
+
+        // Max heap of the closest points so far, so that the memory doesn't grow with the base
         std::vector<std::pair<float, int>> points_for_x_filter;
+        points_for_x_filter.reserve(GROUND_TRUTH_SIZE + 1);
 
         // Find the category value of the query
         float query_category_value = query_category_values == nullptr ? -1 : (*query_category_values)[i];
 
+        // Find the timestamp range of the query, if there is one
+        bool has_range = query_ranges != nullptr && base_timestamps != nullptr;
+        float low = has_range ? (*query_ranges)[i].first : 0;
+        float high = has_range ? (*query_ranges)[i].second : 0;
+
         // Calculate the distance of the query point to all the points in the base that have the same category value
         // If category value is -1, calculate the distance to all the points in the base
         std::size_t m = base_points.size();
         for(std::size_t j = 0; j < m; j++){
+            if(has_range && ((*base_timestamps)[j] < low || (*base_timestamps)[j] > high))
+                continue;
+
             if(query_category_value == -1 || (base_category_values != nullptr && (*base_category_values)[j] == query_category_value)){
-                float distance = calculateDistance(query, base_points[j], query.size());
-                points_for_x_filter.emplace_back(std::make_pair(distance, j));
+                float distance = 0.0f;
+                if constexpr(Metric::normalized){
+                    distance = Metric::finish(metricSum<Metric>(query.data(), base_points[j].data(), query.size()) * inverse_norms[j]);
+                }
+                else{
+                    distance = metricDistance<Metric>(query, base_points[j], query.size());
+                }
+                if(points_for_x_filter.size() == GROUND_TRUTH_SIZE && distance >= points_for_x_filter.front().first)
+                    continue;
+
+                points_for_x_filter.emplace_back(distance, (int)j);
+                std::push_heap(points_for_x_filter.begin(), points_for_x_filter.end());
+                if(points_for_x_filter.size() > GROUND_TRUTH_SIZE){
+                    std::pop_heap(points_for_x_filter.begin(), points_for_x_filter.end());
+                    points_for_x_filter.pop_back();
+                }
             }
         }
 
         // Sort according to the distance
-        std::sort(points_for_x_filter.begin(), points_for_x_filter.end(), 
-        [](const std::pair<float, int>& a, const std::pair<float, int>& b){ // Lambda function
-            return a.first < b.first;
-        });
+        std::sort_heap(points_for_x_filter.begin(), points_for_x_filter.end());
+        ground_truth[i] = std::move(points_for_x_filter);
+    }, config);
+}
+
+// Save the indexes of the ground truth in ivecs format
+void saveGroundTruth(const std::string& file_path, const std::vector<std::vector<std::pair<float, int>>>& ground_truth){
+    std::ofstream file(file_path, std::ios::binary);
+    if(!file){
+        throw std::runtime_error("Could not open file to save ground truth");
+    }
+
+    for(const auto& query_gt : ground_truth){
+        int dimension = (int)query_gt.size();
+        file.write((char*)&dimension, sizeof(int));
+
+        for(const auto& [distance, index] : query_gt){
+            file.write((char*)&index, sizeof(int));
+        }
+    }
 
-        // Keep maximum 100 points
-        int size_gt = (int)std::min(points_for_x_filter.size(), (size_t)100);
-        ground_truth[i].assign(points_for_x_filter.begin(), points_for_x_filter.begin() + size_gt);
+    file.close();
+}
+
+
+// Queries of a replay with the latency of every query
+struct ReplayResult{
+    LatencyHistogram latency;
+    double seconds = 0.0;
+    std::size_t queries = 0;
+    std::size_t correct = 0;
+    std::size_t total = 0;
+
+    double qps() const{
+        return this->seconds > 0.0 ? this->queries / this->seconds : 0.0;
+    }
+
+    double recall() const{
+        return this->total == 0 ? 0.0 : (double)this->correct / this->total * 100;
+    }
+};
+
+// Run query(i) for every i in [0, n) on workers threads. query returns the points of the ground truth it
+// found and the size of the ground truth. With a rate, query i arrives at i / rate seconds from the start
+// and its latency counts from the arrival, so a slow query also counts for the queries that wait behind it.
+// Without a rate a worker takes the next query as soon as it is free. The first exception of a query
+// stops the replay and is thrown again after the workers finish.
+template <typename Query>
+static ReplayResult replayQueries(std::size_t n, int workers, double rate, Query query){
+    ReplayResult result;
+    result.queries = n;
+    std::atomic<std::size_t> next(0);
+    std::exception_ptr error = nullptr;
+
+    auto start = std::chrono::steady_clock::now();
+    #pragma omp parallel num_threads(std::max(workers, 1))
+    {
+        LatencyHistogram latency;
+        std::size_t correct = 0;
+        std::size_t total = 0;
+
+        for(std::size_t i = next++; i < n; i = next++){
+            auto arrival = std::chrono::steady_clock::now();
+            if(rate > 0.0){
+                arrival = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(i / rate));
+                std::this_thread::sleep_until(arrival);
+            }
+
+            try{
+                auto [found, k] = query(i);
+                latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - arrival).count());
+                correct += found;
+                total += k;
+            }
+            catch(...){
+                #pragma omp critical
+                if(error == nullptr)
+                    error = std::current_exception();
+                next = n;
+            }
+        }
+
+        #pragma omp critical
+        {
+            result.latency.merge(latency);
+            result.correct += correct;
+            result.total += total;
+        }
     }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if(error != nullptr)
+        std::rethrow_exception(error);
+
+    return result;
 }
 
+static void printReplay(const std::string& name, const ReplayResult& result){
+    const LatencyHistogram& latency = result.latency;
+    std::streamsize precision = std::cout.precision();
+    std::cout << BLUE << "QPS and latency (us) for " << name << " : " << RESET << std::fixed << std::setprecision(1)
+              << result.qps() << " QPS, p50 " << latency.percentile(50) / 1e3 << ", p90 " << latency.percentile(90) / 1e3
+              << ", p99 " << latency.percentile(99) / 1e3 << ", p99.9 " << latency.percentile(99.9) / 1e3
+              << ", max " << latency.max() / 1e3 << std::defaultfloat << std::setprecision(precision) << std::endl;
+}
+
+// Latency percentiles in microseconds as columns of the log
+static void logLatency(std::ostream& log_file, const LatencyHistogram& latency){
+    log_file << '\t' << latency.percentile(50) / 1e3 << '\t' << latency.percentile(90) / 1e3 << '\t' << latency.percentile(99) / 1e3 << '\t' << latency.percentile(99.9) / 1e3;
+}
+
+// Run every group of queries once for every L and k of the config on the same index and write a row
+// of recall@k, QPS and latency for each to the sweep CSV. query(i, L, k) runs query i like in replayQueries.
+template <typename Query>
+static void runSweep(const RuntimeConfig& config, const std::vector<std::pair<std::string, std::vector<std::size_t>>>& groups, Query query){
+    std::ofstream csv(config.sweep_file);
+    if(!csv){
+        throw std::runtime_error("Could not open file to save sweep");
+    }
+    csv << "group,L,k,queries,recall,qps,mean_us,p50_us,p90_us,p99_us,p999_us" << std::endl;
+
+    for(int search_L : config.sweep_L){
+        for(int search_k : config.sweep_k){
+            if(search_L < search_k){
+                std::cout << YELLOW << "Skipping L = " << search_L << " that is smaller than k = " << search_k << RESET << std::endl;
+                continue;
+            }
+
+            for(const auto& [name, ids] : groups){
+                if(ids.empty())
+                    continue;
+
+                ReplayResult result = replayQueries(ids.size(), config.workers, 0.0, [&](std::size_t j){ return query(ids[j], search_L, search_k); });
+                const LatencyHistogram& latency = result.latency;
+                csv << name << ',' << search_L << ',' << search_k << ',' << ids.size() << ',' << result.recall() << ',' << result.qps() << ','
+                    << latency.mean() / 1e3 << ',' << latency.percentile(50) / 1e3 << ',' << latency.percentile(90) / 1e3 << ','
+                    << latency.percentile(99) / 1e3 << ',' << latency.percentile(99.9) / 1e3 << std::endl;
+
+                std::cout << BLUE << "L = " << search_L << ", k = " << search_k << ", " << name << " : " << RESET << result.recall() << "% recall, " << result.qps() << " QPS" << std::endl;
+            }
+        }
+    }
+
+    std::cout << GREEN << "Sweep saved to " << config.sweep_file << RESET << std::endl;
+}
 
 void processBinFormat(const std::string& file_path_base, const std::string& file_path_query, const std::string& file_path_gt, float alpha, int R, int L, 
-    const std::string& file_path_load, const std::string& file_path_save, const std::string& algo, bool do_query, const std::string& file_path_log){
+    const std::string& file_path_load, const std::string& file_path_save, const std::string& algo, bool do_query, const std::string& file_path_log, bool nn_descent, const std::vector<VamanaPass>& passes, int bridges, const RuntimeConfig& config){
     
     std::vector<std::vector<float>> base;
     std::vector<float> base_category_values;
+    std::vector<float> base_timestamps;
     std::vector<std::vector<float>> queries;
+    std::vector<int> query_types;
     std::vector<float> query_category_values;
+    std::vector<std::pair<float, float>> query_ranges;
 
 
-    long memoryBefore = 0, memoryAfter = 0 , memoryUsed = 0;
-    parseDataVector(file_path_base, base_category_values, base);
-    parseQueryVector(file_path_query, query_category_values, queries);
+    long memoryUsed = 0;
+    parseDataVector(file_path_base, base_category_values, base_timestamps, base);
+    parseQueryVector(file_path_query, query_types, query_category_values, query_ranges, queries);
+
+    // Queries without a timestamp range accept every timestamp
+    for(std::size_t i = 0; i < queries.size(); i++){
+        if(query_types[i] < 2){
+            query_ranges[i] = std::make_pair(-std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity());
+        }
+        else if(query_types[i] == 2){
+            query_category_values[i] = -1;
+        }
+    }
 
     std::vector<std::vector<int>> gt;
 
@@ -146,7 +441,7 @@ void processBinFormat(const std::string& file_path_base, const std::string& file
 
         // Create the file name for the calculated ground truth
         std::ostringstream file_name_stream;
-        std::string algorithm_used = "filtered";
+        std::string algorithm_used = "filtered_range";
         std::string dataset_name = (base.size()<size_t(100000)) ? "_small" : "_large";
         file_name_stream << "./groundtruth/groundtruth" << dataset_name << "_" << algorithm_used << ".bin";
         file_name = file_name_stream.str();
@@ -156,24 +451,10 @@ void processBinFormat(const std::string& file_path_base, const std::string& file
             // Calculate the ground truth
             std::cout << BLUE << "Calculating ground truth. This may take a while..." << RESET << std::endl;
             std::vector<std::vector<std::pair<float, int>>> temp_gt;
-            calculateGroundTruth(queries, base, temp_gt, &query_category_values, &base_category_values);
-        
-            std::ofstream file(file_name, std::ios::binary);
-            if(!file){
-                throw std::runtime_error("Could not open file to save ground truth");
-            }
+            calculateGroundTruth(queries, base, temp_gt, &query_category_values, &base_category_values, &query_ranges, &base_timestamps, config);
 
             // Save the ground truth to the file
-            for(const auto& query_gt : temp_gt){
-                int dimension = (int)query_gt.size();
-                file.write((char*)&dimension, sizeof(int));
-
-                for(const auto& [distance, index] : query_gt){
-                    file.write((char*)&index, sizeof(int));
-                }
-            }
-
-            file.close();
+            saveGroundTruth(file_name, temp_gt);
         }
     }
 
@@ -185,27 +466,42 @@ void processBinFormat(const std::string& file_path_base, const std::string& file
         throw std::runtime_error("Parsing failed and returned empty vectors");
     }
 
+    // Every query needs its row of the ground truth, a ground truth of another query file or of an old format misaligns them
+    if(gt.size() != queries.size()){
+        std::cerr << "Error : Ground truth has " << gt.size() << " rows but there are " << queries.size() << " queries" << RESET << std::endl;
+        throw std::invalid_argument("processBinFormat: ground truth " + file_name + " doesn't match the queries");
+    }
+
     std::cout << GREEN << "Files parsed successfully" << RESET << std::endl;
 
-    // Init ANN class and run Vamana algorithm
-    memoryBefore = getPeakMemoryUsage();
-    ANN<float> ann(base, base_category_values);
+    // Build with a single pass using alpha and L if no passes are given
+    std::vector<VamanaPass> build_passes = passes;
+    if(build_passes.empty()){
+        build_passes.push_back({alpha, L});
+    }
+
+    // Init ANN class and run Vamana algorithm. The resident memory is sampled from the copy of the points to the end of the build.
+    RssSampler sampler;
+    sampler.start();
+    // The points are moved into the index and the filters and timestamps are copied, so the parser buffers
+    // are released before the build
+    ANN<float> ann(std::move(base), base_category_values, base_timestamps);
+    std::vector<float>().swap(base_category_values);
+    std::vector<float>().swap(base_timestamps);
+    ann.config = config;
     
 
     // Open the file to write the graph
     if(file_path_load.empty()){
         if(algo == "stitch"){
             std::cout << BLUE << "Running stitched Vamana algorithm to create the graph" << RESET << std::endl;
-            int z = 0;
-            #if defined(OPTIMIZED)
-                z = (R / 2);
-            #endif
+            int z = config.stitch_random_edges < 0 ? R / 2 : config.stitch_random_edges;
             auto start = std::chrono::high_resolution_clock::now();
-            ann.stitchedVamana(alpha, L, (int)(R / 2), R, z);
+            ann.stitchedVamana(build_passes, (int)(R / 2), R, z, nn_descent);
+            ann.addBridgeEdges(bridges, alpha, L);
             auto end = std::chrono::high_resolution_clock::now();
             auto time_indexing = std::chrono::duration<double>(end - start).count();
-            memoryAfter = getPeakMemoryUsage();
-            memoryUsed = memoryAfter - memoryBefore;
+            memoryUsed = reportBuildMemory(ann, sampler, config);
 
             if(!file_path_log.empty()){
                 std::ofstream log_file(file_path_log, std::ios::app);
@@ -223,11 +519,11 @@ void processBinFormat(const std::string& file_path_base, const std::string& file
             std::cout << BLUE << "Running filtered Vamana algorithm to create the graph" << RESET << std::endl;
             int z = 0;
             auto start = std::chrono::high_resolution_clock::now();
-            ann.filteredVamana(alpha, L, R, z);
+            ann.filteredVamana(build_passes, R, z, nn_descent);
+            ann.addBridgeEdges(bridges, alpha, L);
             auto end = std::chrono::high_resolution_clock::now();
             auto time_indexing = std::chrono::duration<double>(end - start).count();
-            memoryAfter = getPeakMemoryUsage();
-            memoryUsed = memoryAfter - memoryBefore;
+            memoryUsed = reportBuildMemory(ann, sampler, config);
 
             std::cout << GREEN << "Filtered Vamana Graph executed successfully" << RESET << std::endl;
             if(!file_path_log.empty()){
@@ -246,124 +542,159 @@ void processBinFormat(const std::string& file_path_base, const std::string& file
     }
     else{
         // Load the graph from the file
+        sampler.stop();
         ann.loadGraph(file_path_load);
         std::cout << GREEN << "Graph loaded successfully" << RESET << std::endl;
 
         // Run filtered find medoid to fill filter_to_start_node used in filteredGreedySearch
         ann.filteredFindMedoid();
     }
+    reorderIndex(ann, gt, file_path_load.empty(), config);
 
     if(do_query){
-        int total_correct_guesses = 0;
-        int total_gt_size = 0;
-
-        std::size_t size_q = 0;
-        if(queries.size() > 500) size_q = 500;
-        else size_q = queries.size();
-
-        // Seperate filtered from unfiltered queries
-        std::vector<std::vector<int>> gt_filtered;
-        std::vector<std::vector<int>> gt_unfiltered;
-        std::vector<std::vector<float>> queries_filtered;
-        std::vector<std::vector<float>> queries_unfiltered;
-        std::vector<float> query_category_values_filtered;
-        std::vector<float> query_category_values_unfiltered;
-
-        for(std::size_t i = 0; i < size_q; i++){
-            if(query_category_values[i] == -1){
-                gt_unfiltered.push_back(gt[i]);
-                queries_unfiltered.push_back(queries[i]);
-                query_category_values_unfiltered.push_back(query_category_values[i]);
-            }
-            else{
-                gt_filtered.push_back(gt[i]);
-                queries_filtered.push_back(queries[i]);
-                query_category_values_filtered.push_back(query_category_values[i]);
-            }
-        }
-
-        // Run filtered queries
-        std::size_t size_filtered = queries_filtered.size();
-        auto start_filtered = std::chrono::high_resolution_clock::now();
-        for(std::size_t i = 0; i < size_filtered; i++){
-            int k = (int)gt_filtered[i].size();
+        // Only the queries that have a ground truth are run
+        std::size_t size_gt = std::min(queries.size(), gt.size());
+        std::size_t size_q = std::min(size_gt, std::size_t(500));
+
+        // Find the medoid before the queries, so that the workers only read the index
+        if(bridges > 0)
+            ann.startMedoid();
+
+        // Run query i with list size search_L and return how many of the first k points of the ground truth
+        // it found and k. k is search_k or the size of the ground truth if it is smaller or search_k is 0.
+        auto run_query = [&](std::size_t i, int search_L, int search_k, SearchStats* query_stats) -> std::pair<int, int>{
+            int k = search_k > 0 ? std::min(search_k, (int)gt[i].size()) : (int)gt[i].size();
             if(k > 100){
                 std::cout << YELLOW << "Ground truth has more than 100 points" << RESET << std::endl;
             }
+            if(k == 0) return {0, 0};
 
-            CompareVectors<float> compare(ann.node_to_point_map, queries_filtered[i]);
+            CompareVectors<float> compare(ann.node_to_point_map, queries[i], config.precompute_search);
             std::set<int, CompareVectors<float>> NNS(compare);
             std::unordered_set<int> Visited;
 
-            int start_node = ann.getStartNode(query_category_values_filtered[i]);
-            if(start_node == -1) continue;
-            ann.filteredGreedySearch(start_node, k, L, query_category_values_filtered[i], NNS, Visited, compare);
+            float filter = query_category_values[i];
+            if(query_types[i] >= 2){
+                int start_node = filter == -1 ? -1 : ann.getStartNode(filter);
+                ann.rangeGreedySearch(start_node, k, search_L, filter, query_ranges[i].first, query_ranges[i].second, NNS, Visited, compare);
+            }
+            else if(filter == -1){
+                // With bridge edges the whole graph is connected, so a greedy search from the medoid is enough
+                if(bridges > 0){
+                    NNS.insert(ann.startMedoid());
+                    ann.greedySearch(ann.startMedoid(), k, search_L, NNS, Visited, compare, query_stats);
+                }
+                else{
+                    ann.filteredGreedySearch(-1, k, search_L, -1, NNS, Visited, compare, query_stats);
+                }
+            }
+            else{
+                int start_node = ann.getStartNode(filter);
+                if(start_node == -1) return {0, 0};
+                ann.filteredGreedySearch(start_node, k, search_L, filter, NNS, Visited, compare, query_stats);
+            }
 
             // Search in the ground truth
             int correct = 0;
-            for(const int& index : gt_filtered[i]){
-                if(NNS.find(index) != NNS.end()){
+            for(int j = 0; j < k; j++){
+                if(NNS.find(gt[i][j]) != NNS.end()){
                     correct++;
                 }
             }
-            
-            total_correct_guesses += correct;
-            total_gt_size += k;
-        }
-        auto end_filtered = std::chrono::high_resolution_clock::now();
-        auto time_query_filtered = std::chrono::duration_cast<std::chrono::milliseconds>(end_filtered - start_filtered).count();
-        auto queries_per_second_filtered = (float)size_filtered / time_query_filtered * 1000;
-
-        float total_recall_filtered = (float)total_correct_guesses / total_gt_size * 100;
-        std::cout << BLUE << "Total recall for filtered queries : " << RESET << total_recall_filtered << "%" << std::endl;
-
-        // Run unfiltered queries
-        total_correct_guesses = 0;
-        total_gt_size = 0;
-
-        std::size_t size_unfiltered = queries_unfiltered.size();
-        auto start_unfiltered = std::chrono::high_resolution_clock::now();
-        for(std::size_t i = 0; i < size_unfiltered; i++){
-            int k = (int)gt_unfiltered[i].size();
-            if(k > 100){
-                std::cout << YELLOW << "Ground truth has more than 100 points" << RESET << std::endl;
+            return {correct, k};
+        };
+
+        std::string dataset_name = (ann.node_to_point_map.size() <= size_t(10000)) ? "small" : "large";
+
+        if(!config.sweep_file.empty()){
+            // Every query of the file, split to the groups that are reported separately
+            std::vector<std::pair<std::string, std::vector<std::size_t>>> groups = {{"filtered", {}}, {"unfiltered", {}}, {"range", {}}};
+            for(std::size_t i = 0; i < size_gt; i++){
+                if(query_types[i] >= 2)
+                    groups[2].second.push_back(i);
+                else if(query_category_values[i] == -1)
+                    groups[1].second.push_back(i);
+                else
+                    groups[0].second.push_back(i);
             }
 
-            CompareVectors<float> compare(ann.node_to_point_map, queries_unfiltered[i]);
-            std::set<int, CompareVectors<float>> NNS(compare);
-            std::unordered_set<int> Visited;
-
-            // Call unfiltered Greedy
-            ann.filteredGreedySearch(-1, k, L, -1, NNS, Visited, compare);
+            runSweep(config, groups, [&](std::size_t i, int search_L, int search_k){ return run_query(i, search_L, search_k, nullptr); });
+        }
+        else if(config.benchmark){
+            // Replay the whole query file in its order, with every type of query mixed like in production
+            std::cout << BLUE << "Replaying " << size_gt << " queries with " << config.workers << " workers" << RESET << std::endl;
+            ReplayResult replay = replayQueries(size_gt, config.workers, config.arrival_rate, [&](std::size_t i){ return run_query(i, L, 0, nullptr); });
+            printReplay("all queries", replay);
 
-            // Search in the ground truth
-            int correct = 0;
-            for(const int& index : gt_unfiltered[i]){
-                if(NNS.find(index) != NNS.end()){
-                    correct++;
+            if(!file_path_log.empty()){
+                std::ofstream log_file(file_path_log, std::ios::app);
+                if(!log_file){
+                    throw std::runtime_error("Could not open file to save log");
                 }
+
+                log_file << '\t' << "replay" << '\t' << config.workers << '\t' << config.arrival_rate << '\t' << algo << '\t' << dataset_name << '\t' << replay.qps() << '\t' << replay.recall();
+                logLatency(log_file, replay.latency);
+                log_file << std::endl;
+                log_file.close();
             }
-            
-            total_correct_guesses += correct;
-            total_gt_size += k;
         }
-        auto end_unfiltered = std::chrono::high_resolution_clock::now();
-        auto time_query_unfiltered = std::chrono::duration_cast<std::chrono::milliseconds>(end_unfiltered - start_unfiltered).count();
-        auto queries_per_second_unfiltered = (float)size_unfiltered / time_query_unfiltered * 1000;
+        else{
+            // Seperate filtered, unfiltered and range queries
+            std::vector<std::size_t> filtered_ids;
+            std::vector<std::size_t> unfiltered_ids;
+            std::vector<std::size_t> range_ids;
+            for(std::size_t i = 0; i < size_q; i++){
+                if(query_types[i] >= 2)
+                    range_ids.push_back(i);
+                else if(query_category_values[i] == -1)
+                    unfiltered_ids.push_back(i);
+                else
+                    filtered_ids.push_back(i);
+            }
 
-        float total_recall_unfiltered = (float)total_correct_guesses / total_gt_size * 100;
-        std::cout << BLUE << "Total recall for unfiltered queries : " << RESET << total_recall_unfiltered << "%" << std::endl;
+            // Run filtered queries
+            STATS_ONLY(std::vector<SearchStats> stats_filtered(filtered_ids.size());)
+            ReplayResult filtered = replayQueries(filtered_ids.size(), 1, 0.0, [&](std::size_t j){
+                SearchStats* query_stats = nullptr;
+                STATS_ONLY(query_stats = &stats_filtered[j];)
+                return run_query(filtered_ids[j], L, 0, query_stats);
+            });
+            std::cout << BLUE << "Total recall for filtered queries : " << RESET << filtered.recall() << "%" << std::endl;
+            printReplay("filtered queries", filtered);
+            STATS_ONLY(printSearchStats("filtered queries", stats_filtered);)
+
+            // Run unfiltered queries
+            STATS_ONLY(std::vector<SearchStats> stats_unfiltered(unfiltered_ids.size());)
+            ReplayResult unfiltered = replayQueries(unfiltered_ids.size(), 1, 0.0, [&](std::size_t j){
+                SearchStats* query_stats = nullptr;
+                STATS_ONLY(query_stats = &stats_unfiltered[j];)
+                return run_query(unfiltered_ids[j], L, 0, query_stats);
+            });
+            std::cout << BLUE << "Total recall for unfiltered queries : " << RESET << unfiltered.recall() << "%" << std::endl;
+            printReplay("unfiltered queries", unfiltered);
+            STATS_ONLY(printSearchStats("unfiltered queries", stats_unfiltered);)
+
+            // Run range queries
+            ReplayResult range = replayQueries(range_ids.size(), 1, 0.0, [&](std::size_t j){ return run_query(range_ids[j], L, 0, nullptr); });
+            std::cout << BLUE << "Total recall for range queries : " << RESET << range.recall() << "%" << std::endl;
+            printReplay("range queries", range);
 
-        if(!file_path_log.empty()){
-            std::ofstream log_file(file_path_log, std::ios::app);
-            if(!log_file){
-                throw std::runtime_error("Could not open file to save log");
-            }
+            if(!file_path_log.empty()){
+                std::ofstream log_file(file_path_log, std::ios::app);
+                if(!log_file){
+                    throw std::runtime_error("Could not open file to save log");
+                }
 
-            std::string dataset_name = (base.size() <= size_t(10000)) ? "small" : "large";
+                // Latency percentiles of all the queries follow the recall
+                LatencyHistogram latency = filtered.latency;
+                latency.merge(unfiltered.latency);
+                latency.merge(range.latency);
 
-            log_file << '\t' << queries_per_second_filtered << '\t' << queries_per_second_unfiltered << '\t' << algo << '\t' << dataset_name << '\t' << total_recall_filtered << '\t' << total_recall_unfiltered << std::endl;
-            log_file.close();
+                log_file << '\t' << filtered.qps() << '\t' << unfiltered.qps() << '\t' << algo << '\t' << dataset_name << '\t' << filtered.recall() << '\t' << unfiltered.recall() << '\t' << range.qps() << '\t' << range.recall();
+                logLatency(log_file, latency);
+                log_file << std::endl;
+                log_file.close();
+            }
         }
     }
 
@@ -378,21 +709,22 @@ void processBinFormat(const std::string& file_path_base, const std::string& file
     }
 }
 
-template <typename datatype>
+template <typename datatype, typename Metric>
 void processVecFormat(const std::string& file_path_base, const std::string& file_path_query, const std::string& file_path_gt, float alpha, int R, int L,
-     const std::string& file_path_load, const std::string& file_path_save, bool do_query, const std::string& file_path_log){
+     const std::string& file_path_load, const std::string& file_path_save, bool do_query, const std::string& file_path_log, bool nn_descent, const std::vector<VamanaPass>& passes, const RuntimeConfig& config){
     
     std::vector<std::vector<datatype>> base = parseVecs<datatype>(file_path_base);
     std::vector<std::vector<datatype>> query = parseVecs<datatype>(file_path_query);
     std::vector<std::vector<int>> gt;
-    long memoryBefore = 0, memoryAfter = 0, memoryUsed = 0;
+    long memoryUsed = 0;
 
     std::string file_name = file_path_gt;
     // If the ground truth file is not provided, calculate the ground truth and save it to a file
     if(file_path_gt.empty()){
         // Create the file name for the calculated ground truth
         std::ostringstream file_name_stream;
-        std::string algorithm_used = "unfiltered";
+        // Metrics other than L2 have their own file
+        std::string algorithm_used = std::string("unfiltered") + (std::is_same<Metric, L2Metric>::value ? "" : std::string("_") + Metric::name);
         std::string dataset_name = (base.size()<size_t(100000)) ? "_small" : "_large";
         file_name_stream << "./groundtruth/groundtruth" << dataset_name << "_" << algorithm_used << ".bin";
         file_name = file_name_stream.str();
@@ -401,23 +733,8 @@ void processVecFormat(const std::string& file_path_base, const std::string& file
         if(!std::filesystem::exists(file_name)){
             std::cout << BLUE << "Calculating ground truth. This may take a while..." << RESET << std::endl;
             std::vector<std::vector<std::pair<float, int>>> temp_gt;
-            calculateGroundTruth(query, base, temp_gt);
-            
-            std::ofstream file(file_name, std::ios::binary);
-            if(!file){
-                throw std::runtime_error("Could not open file to save ground truth");
-            }
-
-            for(const auto& query_gt : temp_gt){
-                int dimension = (int)query_gt.size();
-                file.write((char*)&dimension, sizeof(int));
-
-                for(const auto& [distance, index] : query_gt){
-                    file.write((char*)&index, sizeof(int));
-                }
-            }
-
-            file.close();
+            calculateGroundTruth<datatype, Metric>(query, base, temp_gt, nullptr, nullptr, nullptr, nullptr, config);
+            saveGroundTruth(file_name, temp_gt);
         }
     }
     
@@ -431,9 +748,18 @@ void processVecFormat(const std::string& file_path_base, const std::string& file
 
     std::cout << GREEN << "Files parsed successfully" << RESET << std::endl;
 
-    // Init ANN class and run Vamana algorithm
-    memoryBefore = getPeakMemoryUsage();
-    ANN<datatype> ann(base, (size_t)R);
+    // Build with a single pass using alpha and L if no passes are given
+    std::vector<VamanaPass> build_passes = passes;
+    if(build_passes.empty()){
+        build_passes.push_back({alpha, L});
+    }
+
+    // Init ANN class and run Vamana algorithm. The resident memory is sampled from the copy of the points to the end of the build.
+    RssSampler sampler;
+    sampler.start();
+    // The points are moved into the index, so that they are not kept twice during the build
+    ANN<datatype, Metric> ann(std::move(base), (size_t)R);
+    ann.config = config;
     std::cout << GREEN << "ANN class initialized successfully" << RESET << std::endl;
     
     // Open the file to write the graph
@@ -441,10 +767,9 @@ void processVecFormat(const std::string& file_path_base, const std::string& file
         std::cout << BLUE << "Running Vamana algorithm to create the graph" << RESET << std::endl;
         
         auto start = std::chrono::high_resolution_clock::now();
-        ann.Vamana(alpha, L, R);
+        ann.Vamana(build_passes, R, nn_descent);
         auto end = std::chrono::high_resolution_clock::now();
-        memoryAfter = getPeakMemoryUsage();
-        memoryUsed = memoryAfter - memoryBefore;
+        memoryUsed = reportBuildMemory(ann, sampler, config);
         auto time_indexing = std::chrono::duration<double>(end - start).count();
 
         if(!file_path_log.empty()){
@@ -461,60 +786,129 @@ void processVecFormat(const std::string& file_path_base, const std::string& file
     }
     else{
         // Load the graph from the file
+        sampler.stop();
         ann.loadGraph(file_path_load);
         std::cout << GREEN << "Graph loaded successfully" << RESET << std::endl;
     }
+    reorderIndex(ann, gt, file_path_load.empty(), config);
 
     if(do_query){
         // For every query point, find the results and compare with ground truth
-        int total_correct_guesses = 0;
-        int total_gt_size = 0;
-
         std::size_t size_q = 0;
         if(query.size() > 500) size_q = 500;
         else size_q = query.size();
 
-        auto start = std::chrono::high_resolution_clock::now();
-        for(std::size_t i = 0; i < size_q; i++){
-            int k = (int)gt[i].size();
+        // Find the medoid before the queries, so that the workers only read the index
+        int medoid = ann.startMedoid();
 
-            CompareVectors<datatype> compare(ann.node_to_point_map, query[i]);
-            std::set<int, CompareVectors<datatype>> NNS(compare);
+        // Statistics are kept only for the regular run of the first queries one at a time
+        STATS_ONLY(bool keep_stats = !config.benchmark && config.sweep_file.empty() && config.search_batch == 1;
+                   std::vector<SearchStats> stats(keep_stats ? size_q : 0);)
+        auto run_query = [&](std::size_t i, int search_L, int search_k) -> std::pair<int, int>{
+            int k = search_k > 0 ? std::min(search_k, (int)gt[i].size()) : (int)gt[i].size();
+
+            CompareVectors<datatype, Metric> compare(ann.node_to_point_map, query[i], config.precompute_search);
+            std::set<int, CompareVectors<datatype, Metric>> NNS(compare);
             std::unordered_set<int> Visited;
+            SearchStats* query_stats = nullptr;
+            STATS_ONLY(if(keep_stats) query_stats = &stats[i];)
 
             // Call Greedy search to find the nearest neighbours
-            ann.greedySearch(ann.getMedoid(), k, L, NNS, Visited, compare);
+            ann.greedySearch(medoid, k, search_L, NNS, Visited, compare, query_stats);
 
             // Search in the ground truth
             int correct = 0;
-            for(const int& index : gt[i]){
-                if(NNS.find(index) != NNS.end()){
+            for(int j = 0; j < k; j++){
+                if(NNS.find(gt[i][j]) != NNS.end()){
                     correct++;
                 }
             }
+            return {correct, k};
+        };
+
+        // Run the count queries from first together and return the points of the ground truth they found and k
+        auto run_batch = [&](std::size_t first, std::size_t count, int search_L) -> std::pair<int, int>{
+            std::vector<CompareVectors<datatype, Metric>> compares;
+            std::vector<std::set<int, CompareVectors<datatype, Metric>>> NNS;
+            compares.reserve(count);
+            NNS.reserve(count);
+            int k_max = 0;
+            for(std::size_t i = first; i < first + count; i++){
+                compares.emplace_back(ann.node_to_point_map, query[i], config.precompute_search);
+                NNS.emplace_back(compares.back());
+                k_max = std::max(k_max, (int)gt[i].size());
+            }
+            std::vector<std::unordered_set<int>> Visited(count);
 
-            total_correct_guesses += correct;
-            total_gt_size += k; 
-        }
-        auto end = std::chrono::high_resolution_clock::now();
-        auto time_query = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-        auto queries_per_second = (float)size_q / time_query * 1000;
+            ann.batchGreedySearch(medoid, k_max, search_L, NNS, Visited, compares);
 
-        float total_recall = (float)total_correct_guesses / total_gt_size * 100;
-        std::cout << BLUE << "Total recall : " << RESET << total_recall << "%" << std::endl;
+            // Every query keeps the k of its own ground truth
+            int correct = 0, total = 0;
+            for(std::size_t j = 0; j < count; j++){
+                const std::vector<int>& query_gt = gt[first + j];
+                int k = (int)query_gt.size();
+                if(NNS[j].size() > (std::size_t)k)
+                    NNS[j].erase(std::next(NNS[j].begin(), k), NNS[j].end());
 
-        if(!file_path_log.empty()){
-            // Open the log file
-            std::ofstream log_file(file_path_log, std::ios::app);
-            if(!log_file){
-                throw std::runtime_error("Could not open log file");
+                for(int id : query_gt){
+                    if(NNS[j].find(id) != NNS[j].end())
+                        correct++;
+                }
+                total += k;
+            }
+            return {correct, total};
+        };
+
+        // With -batch every task of the replay is a batch of queries, whose queries all finish with it
+        auto replay = [&](std::size_t n, int workers, double rate) -> ReplayResult{
+            if(config.search_batch == 1)
+                return replayQueries(n, workers, rate, [&](std::size_t i){ return run_query(i, L, 0); });
+
+            std::size_t batch = (std::size_t)config.search_batch;
+            ReplayResult result = replayQueries((n + batch - 1) / batch, workers, rate / batch, [&](std::size_t b){
+                return run_batch(b * batch, std::min(batch, n - b * batch), L);
+            });
+            result.queries = n;
+            return result;
+        };
+
+        if(!config.sweep_file.empty()){
+            std::vector<std::size_t> ids(std::min(query.size(), gt.size()));
+            std::iota(ids.begin(), ids.end(), 0);
+            runSweep(config, {{"unfiltered", ids}}, [&](std::size_t i, int search_L, int search_k){ return run_query(i, search_L, search_k); });
+        }
+        else{
+            // The benchmark mode replays every query with the workers and the arrival rate of the config
+            ReplayResult result;
+            if(config.benchmark){
+                std::size_t size_replay = std::min(query.size(), gt.size());
+                std::cout << BLUE << "Replaying " << size_replay << " queries with " << config.workers << " workers" << RESET << std::endl;
+                result = replay(size_replay, config.workers, config.arrival_rate);
+            }
+            else{
+                result = replay(size_q, 1, 0.0);
             }
-            // Write the time used to the log file
 
-            std::string dataset_size = (base.size() <= size_t(10000)) ? "small" : "large";
+            std::cout << BLUE << "Total recall : " << RESET << result.recall() << "%" << std::endl;
+            printReplay("queries", result);
+            STATS_ONLY(printSearchStats("queries", stats);)
 
-            log_file << '\t' << queries_per_second << '\t' << "regular" << '\t' << dataset_size << '\t' << total_recall << std::endl;
-            log_file.close();
+            if(!file_path_log.empty()){
+                // Open the log file
+                std::ofstream log_file(file_path_log, std::ios::app);
+                if(!log_file){
+                    throw std::runtime_error("Could not open log file");
+                }
+                // Write the time used to the log file
+
+                std::string dataset_size = (ann.node_to_point_map.size() <= size_t(10000)) ? "small" : "large";
+                std::string mode = config.benchmark ? "replay" : "regular";
+
+                log_file << '\t' << result.qps() << '\t' << mode << '\t' << dataset_size << '\t' << result.recall();
+                logLatency(log_file, result.latency);
+                log_file << std::endl;
+                log_file.close();
+            }
         }
 
     }
@@ -530,7 +924,21 @@ void processVecFormat(const std::string& file_path_base, const std::string& file
     }
 }
 
+// Explicit instantiation of the ground truth calculation, that is used by the generator too.
+// Cosine normalizes the vectors, so it is only for float.
+template void calculateGroundTruth<int, L2Metric>(const std::vector<std::vector<int>>& queries, const std::vector<std::vector<int>>& base_points, std::vector<std::vector<std::pair<float, int>>>& ground_truth, const std::vector<float>* query_category_values, const std::vector<float>* base_category_values, const std::vector<std::pair<float, float>>* query_ranges, const std::vector<float>* base_timestamps, const RuntimeConfig& config);
+template void calculateGroundTruth<float, L2Metric>(const std::vector<std::vector<float>>& queries, const std::vector<std::vector<float>>& base_points, std::vector<std::vector<std::pair<float, int>>>& ground_truth, const std::vector<float>* query_category_values, const std::vector<float>* base_category_values, const std::vector<std::pair<float, float>>* query_ranges, const std::vector<float>* base_timestamps, const RuntimeConfig& config);
+template void calculateGroundTruth<unsigned char, L2Metric>(const std::vector<std::vector<unsigned char>>& queries, const std::vector<std::vector<unsigned char>>& base_points, std::vector<std::vector<std::pair<float, int>>>& ground_truth, const std::vector<float>* query_category_values, const std::vector<float>* base_category_values, const std::vector<std::pair<float, float>>* query_ranges, const std::vector<float>* base_timestamps, const RuntimeConfig& config);
+template void calculateGroundTruth<int, InnerProductMetric>(const std::vector<std::vector<int>>& queries, const std::vector<std::vector<int>>& base_points, std::vector<std::vector<std::pair<float, int>>>& ground_truth, const std::vector<float>* query_category_values, const std::vector<float>* base_category_values, const std::vector<std::pair<float, float>>* query_ranges, const std::vector<float>* base_timestamps, const RuntimeConfig& config);
+template void calculateGroundTruth<float, InnerProductMetric>(const std::vector<std::vector<float>>& queries, const std::vector<std::vector<float>>& base_points, std::vector<std::vector<std::pair<float, int>>>& ground_truth, const std::vector<float>* query_category_values, const std::vector<float>* base_category_values, const std::vector<std::pair<float, float>>* query_ranges, const std::vector<float>* base_timestamps, const RuntimeConfig& config);
+template void calculateGroundTruth<unsigned char, InnerProductMetric>(const std::vector<std::vector<unsigned char>>& queries, const std::vector<std::vector<unsigned char>>& base_points, std::vector<std::vector<std::pair<float, int>>>& ground_truth, const std::vector<float>* query_category_values, const std::vector<float>* base_category_values, const std::vector<std::pair<float, float>>* query_ranges, const std::vector<float>* base_timestamps, const RuntimeConfig& config);
+template void calculateGroundTruth<float, CosineMetric>(const std::vector<std::vector<float>>& queries, const std::vector<std::vector<float>>& base_points, std::vector<std::vector<std::pair<float, int>>>& ground_truth, const std::vector<float>* query_category_values, const std::vector<float>* base_category_values, const std::vector<std::pair<float, float>>* query_ranges, const std::vector<float>* base_timestamps, const RuntimeConfig& config);
+
 // Explicit instantiation of the processing function
-template void processVecFormat<int>(const std::string& file_path_base, const std::string& file_path_query, const std::string& file_path_gt, float alpha, int R, int L, const std::string& file_path_load, const std::string& file_path_save, bool do_query, const std::string& file_path_log);
-template void processVecFormat<float>(const std::string& file_path_base, const std::string& file_path_query, const std::string& file_path_gt, float alpha, int R, int L, const std::string& file_path_load, const std::string& file_path_save, bool do_quer, const std::string& file_path_log);
-template void processVecFormat<unsigned char>(const std::string& file_path_base, const std::string& file_path_query, const std::string& file_path_gt, float alpha, int R, int L, const std::string& file_path_load, const std::string& file_path_save, bool do_query, const std::string& file_path_log);
\ No newline at end of file
+template void processVecFormat<int, L2Metric>(const std::string& file_path_base, const std::string& file_path_query, const std::string& file_path_gt, float alpha, int R, int L, const std::string& file_path_load, const std::string& file_path_save, bool do_query, const std::string& file_path_log, bool nn_descent, const std::vector<VamanaPass>& passes, const RuntimeConfig& config);
+template void processVecFormat<float, L2Metric>(const std::string& file_path_base, const std::string& file_path_query, const std::string& file_path_gt, float alpha, int R, int L, const std::string& file_path_load, const std::string& file_path_save, bool do_query, const std::string& file_path_log, bool nn_descent, const std::vector<VamanaPass>& passes, const RuntimeConfig& config);
+template void processVecFormat<unsigned char, L2Metric>(const std::string& file_path_base, const std::string& file_path_query, const std::string& file_path_gt, float alpha, int R, int L, const std::string& file_path_load, const std::string& file_path_save, bool do_query, const std::string& file_path_log, bool nn_descent, const std::vector<VamanaPass>& passes, const RuntimeConfig& config);
+template void processVecFormat<int, InnerProductMetric>(const std::string& file_path_base, const std::string& file_path_query, const std::string& file_path_gt, float alpha, int R, int L, const std::string& file_path_load, const std::string& file_path_save, bool do_query, const std::string& file_path_log, bool nn_descent, const std::vector<VamanaPass>& passes, const RuntimeConfig& config);
+template void processVecFormat<float, InnerProductMetric>(const std::string& file_path_base, const std::string& file_path_query, const std::string& file_path_gt, float alpha, int R, int L, const std::string& file_path_load, const std::string& file_path_save, bool do_query, const std::string& file_path_log, bool nn_descent, const std::vector<VamanaPass>& passes, const RuntimeConfig& config);
+template void processVecFormat<unsigned char, InnerProductMetric>(const std::string& file_path_base, const std::string& file_path_query, const std::string& file_path_gt, float alpha, int R, int L, const std::string& file_path_load, const std::string& file_path_save, bool do_query, const std::string& file_path_log, bool nn_descent, const std::vector<VamanaPass>& passes, const RuntimeConfig& config);
+template void processVecFormat<float, CosineMetric>(const std::string& file_path_base, const std::string& file_path_query, const std::string& file_path_gt, float alpha, int R, int L, const std::string& file_path_load, const std::string& file_path_save, bool do_query, const std::string& file_path_log, bool nn_descent, const std::vector<VamanaPass>& passes, const RuntimeConfig& config);
@@ -196,4 +196,75 @@ TEST(FilteredGreedySearch, DifferentKValues){
     upper_limit = 1;
     NNS.insert(start_node);
     EXPECT_THROW(ann.filteredGreedySearch(start_node, k, upper_limit, filter_query_value, NNS, Visited, compare), std::invalid_argument);
-}
\ No newline at end of file
+}
+// Range search returns only the nodes with timestamp in the range
+TEST(FilteredGreedySearch, RangeSearch){
+    std::vector<std::vector<float>> points;
+    std::vector<float> filters;
+    std::vector<float> timestamps;
+    for(int i = 0; i < 1000; i++){
+        points.push_back({(float)i});
+        filters.push_back((float)(i % 2));
+        timestamps.push_back((float)i);
+    }
+
+    ANN<float> ann(points, filters, timestamps);
+    ann.filteredVamana(1.2f, 20, 6);
+
+    std::vector<float> query_vector = {50.0f};
+    CompareVectors<float> compare(ann.node_to_point_map, query_vector);
+    std::set<int, CompareVectors<float>> NNS(compare);
+    std::unordered_set<int> Visited;
+
+    // Most nodes of the filter are in the range, so the graph is searched
+    ann.rangeGreedySearch(ann.getStartNode(0.0f), 5, 20, 0.0f, 40.0f, 960.0f, NNS, Visited, compare);
+    EXPECT_EQ(std::set<int>(NNS.begin(), NNS.end()), std::set<int>({46, 48, 50, 52, 54}));
+
+    // Few nodes are in the range, so they are all compared with the query
+    NNS.clear();
+    Visited.clear();
+    ann.rangeGreedySearch(-1, 3, 20, -1, 100.0f, 110.0f, NNS, Visited, compare);
+    EXPECT_EQ(std::set<int>(NNS.begin(), NNS.end()), std::set<int>({100, 101, 102}));
+
+    // Empty range
+    NNS.clear();
+    Visited.clear();
+    ann.rangeGreedySearch(-1, 3, 20, 1.0f, 2000.0f, 3000.0f, NNS, Visited, compare);
+    EXPECT_TRUE(NNS.empty());
+}
+
+// Points with several labels searched with "any of" and "all of" predicates
+TEST(FilteredGreedySearch, LabelSetSearch){
+    std::vector<std::vector<float>> points;
+    std::vector<std::vector<float>> filter_sets;
+    for(int i = 0; i < 300; i++){
+        points.push_back({(float)i});
+        filter_sets.push_back({(float)(i % 3)});
+        if(i % 5 == 0)
+            filter_sets.back().push_back(10.0f);
+    }
+
+    ANN<float> ann(points, filter_sets);
+    ann.filteredVamana(1.2f, 30, 8);
+
+    std::vector<float> query_vector = {100.0f};
+    CompareVectors<float> compare(ann.node_to_point_map, query_vector);
+    std::set<int, CompareVectors<float>> NNS(compare);
+    std::unordered_set<int> Visited;
+
+    // Points with label 1 or 2, so 99 and 102 are skipped
+    ann.labelSetGreedySearch(3, 30, {1.0f, 2.0f}, MATCH_ANY, NNS, Visited, compare);
+    EXPECT_EQ(std::set<int>(NNS.begin(), NNS.end()), std::set<int>({98, 100, 101}));
+
+    // Points with labels 0 and 10 are the multiples of 15
+    NNS.clear();
+    Visited.clear();
+    ann.labelSetGreedySearch(2, 30, {0.0f, 10.0f}, MATCH_ALL, NNS, Visited, compare);
+    EXPECT_EQ(std::set<int>(NNS.begin(), NNS.end()), std::set<int>({90, 105}));
+
+    // No point has every label of the query
+    NNS.clear();
+    Visited.clear();
+    ann.labelSetGreedySearch(2, 30, {0.0f, 7.0f}, MATCH_ALL, NNS, Visited, compare);
+    EXPECT_TRUE(NNS.empty());
+}
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include "graph.h"
+#include "memory_usage.h"
 
 // Test if the graph is correctly initialized with random edges
 TEST(GraphTest, RandomInit){
@@ -138,4 +139,41 @@ TEST(GraphTest, EnforceRegularDegree){
     for(std::size_t i = 0; i < edges.size(); i++){
         EXPECT_EQ(graph.countNeighbours(i), R) << "Node " << i << " does not have " << R << " neighbors.";
     }
-}
\ No newline at end of file
+}
+
+// The random edges come from a new seed on every run, also without threads
+TEST(GraphTest, EnforceRegularSeed){
+    Graph first(100, true);
+    Graph second(100, true);
+    first.enforceRegular(8, false);
+    second.enforceRegular(8, false);
+
+    std::vector<std::unordered_set<int>> edges;
+    for(std::size_t i = 0; i < 100; i++){
+        edges.push_back(first.getNeighbours(i));
+    }
+    EXPECT_FALSE(second.checkSimilarity(edges));
+}
+
+// Memory of the adjacency grows with the edges and a full set is counted with its buckets
+TEST(GraphTest, MemoryUsage){
+    Graph graph(10, true);
+    std::size_t empty = graph.memoryUsage();
+    EXPECT_GE(empty, 10 * sizeof(std::unordered_set<int>));
+
+    for(int i = 0; i < 10; i++){
+        for(int j = 0; j < 10; j++){
+            if(i != j)
+                graph.addEdge(i, j);
+        }
+    }
+
+    std::size_t full = graph.memoryUsage();
+    EXPECT_GE(full, empty + 90 * (sizeof(void*) + sizeof(int)));
+
+    std::size_t expected = 10 * sizeof(std::unordered_set<int>);
+    for(int i = 0; i < 10; i++){
+        expected += hashSetBytes(graph.getNeighbours(i));
+    }
+    EXPECT_EQ(full, expected);
+}
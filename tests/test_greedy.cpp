@@ -205,4 +205,119 @@ TEST(GreedySearch, KDifferentValues){
     k = 2;
     EXPECT_THROW(ann.greedySearch(start_node, k,upper_limit, NNS, Visited, compare), std::invalid_argument);
     EXPECT_TRUE(NNS.size() == 1);   // Only the start node
-}
\ No newline at end of file
+}
+
+TEST(GreedySearch, Stats){
+    std::vector<std::vector<int>> points = {{1, 2, 3}, {4, 5, 6}, {7, 8, 9}, {10, 11, 12}, {13, 14, 15}, {16, 17, 18}};
+    std::vector<std::unordered_set<int>> edges = {{1, 5}, {0, 2}, {0, 1, 3}, {2, 4}, {1, 5}, {3, 4}};
+    ANN<int> ann(points, edges);
+
+    std::vector<int> query_node = {6, 6, 6};
+    CompareVectors<int> compare(ann.node_to_point_map, query_node);
+    std::set<int, CompareVectors<int>> NNS(compare);
+    std::unordered_set<int> Visited;
+    NNS.insert(0);
+
+    SearchStats stats;
+    ann.greedySearch(0, 2, 3, NNS, Visited, compare, &stats);
+
+    // Without SEARCH_STATS the counters are not touched
+    #if defined(SEARCH_STATS)
+        EXPECT_EQ(stats.visited, Visited.size());
+        EXPECT_EQ(stats.expansions, Visited.size());
+        EXPECT_GE(stats.distances, Visited.size());
+        EXPECT_GT(stats.prunes, 0u);
+    #else
+        EXPECT_EQ(stats.expansions, 0u);
+        EXPECT_EQ(stats.distances, 0u);
+        EXPECT_EQ(stats.visited, 0u);
+    #endif
+}
+
+TEST(GreedySearch, Batch){
+    std::vector<std::vector<float>> points;
+    for(int i = 0; i < 300; i++){
+        points.push_back({(float)(i % 17), (float)(i % 11), (float)(i % 5)});
+    }
+    ANN<float> ann(points, (size_t)6);
+    ann.Vamana(1.2, 30, 6);
+
+    std::vector<std::vector<float>> queries;
+    for(int i = 0; i < 7; i++){
+        queries.push_back({(float)i * 2.5f, (float)i, (float)(i % 3)});
+    }
+
+    std::vector<CompareVectors<float>> compares;
+    std::vector<std::set<int, CompareVectors<float>>> NNS;
+    compares.reserve(queries.size());
+    NNS.reserve(queries.size());
+    for(const auto& query : queries){
+        compares.emplace_back(ann.node_to_point_map, query);
+        NNS.emplace_back(compares.back());
+    }
+    std::vector<std::unordered_set<int>> Visited(queries.size());
+    ann.batchGreedySearch(0, 10, 30, NNS, Visited, compares);
+
+    // Every query of the batch has the result of its own greedy search
+    for(std::size_t i = 0; i < queries.size(); i++){
+        CompareVectors<float> compare(ann.node_to_point_map, queries[i]);
+        std::set<int, CompareVectors<float>> expected(compare);
+        std::unordered_set<int> expected_visited;
+        ann.greedySearch(0, 10, 30, expected, expected_visited, compare);
+
+        EXPECT_EQ(std::vector<int>(NNS[i].begin(), NNS[i].end()), std::vector<int>(expected.begin(), expected.end()));
+        EXPECT_EQ(Visited[i], expected_visited);
+    }
+
+    std::vector<std::unordered_set<int>> wrong(2);
+    EXPECT_THROW(ann.batchGreedySearch(0, 10, 30, NNS, wrong, compares), std::invalid_argument);
+}
+
+// Searches with sets in a scratch arena have the same result as with std::allocator, and the arena grows to
+// the memory of the largest insertion so that the next ones fit in its buffer
+TEST(GreedySearch, ScratchArena){
+    std::vector<std::vector<float>> points;
+    for(int i = 0; i < 300; i++){
+        points.push_back({(float)(i % 17), (float)(i % 11), (float)(i % 5)});
+    }
+    ANN<float> ann(points, (size_t)6);
+    ann.Vamana(1.2, 30, 6);
+
+    std::vector<float> query = {3.5f, 2.0f, 1.0f};
+    CompareVectors<float> compare(ann.node_to_point_map, query);
+    std::set<int, CompareVectors<float>> expected(compare);
+    std::unordered_set<int> expected_visited;
+    expected.insert(0);
+    ann.greedySearch(0, 10, 30, expected, expected_visited, compare);
+
+    ScratchArena arena(64);
+    for(int round = 0; round < 2; round++){
+        arena.reset();
+        CompareVectors<float> scratch_compare(ann.node_to_point_map, query, false, arena.get());
+        ScratchSet<CompareVectors<float>> NNS(scratch_compare, arena.get());
+        ScratchVisited Visited(arena.get());
+        NNS.insert(0);
+        ann.greedySearch(0, 10, 30, NNS, Visited, scratch_compare);
+
+        EXPECT_EQ(std::vector<int>(NNS.begin(), NNS.end()), std::vector<int>(expected.begin(), expected.end()));
+        EXPECT_EQ(std::unordered_set<int>(Visited.begin(), Visited.end()), expected_visited);
+    }
+    std::size_t capacity = arena.capacity();
+    EXPECT_GT(capacity, 64u);
+
+    // The same search fits in the grown buffer
+    arena.reset();
+    {
+        CompareVectors<float> scratch_compare(ann.node_to_point_map, query, false, arena.get());
+        ScratchSet<CompareVectors<float>> NNS(scratch_compare, arena.get());
+        ScratchVisited Visited(arena.get());
+        NNS.insert(0);
+        ann.greedySearch(0, 10, 30, NNS, Visited, scratch_compare);
+    }
+    arena.reset();
+    EXPECT_EQ(arena.capacity(), capacity);
+
+    // The build releases the buffer when it ends
+    EXPECT_EQ(arena.release(), capacity);
+    EXPECT_EQ(arena.capacity(), 0u);
+}
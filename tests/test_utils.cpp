@@ -2,6 +2,8 @@
 #include "utils_ann.h"
 #include "ann.h"
 #include "parse.h"
+#include "latency.h"
+#include "memory_usage.h"
 
 // Create a file using the format described bellow
 /*
@@ -140,4 +142,228 @@ TEST(FilteredFindMedoid, BasicFunctionality){
     ANN<int> ann(points, filters);
     ann.filteredFindMedoid();
     EXPECT_TRUE(ann.checkFilteredFindMedoid(5));
-}
\ No newline at end of file
+}
+TEST(UtilsANN, SubsetVectorComparison){
+    std::vector<std::vector<int>> vec = {{100, 100, 100}, {15, 25, 35}, {50, 50, 50}, {4, 25, 35}};
+    std::vector<int> base_vec = {10, 20, 30};
+
+    // Nodes 1 and 3 form a sub-graph with local positions 0 and 1
+    std::vector<int> local_index = {-1, 0, -1, 1};
+    CompareVectors<int> vector_comparator(vec, base_vec, local_index, 2);
+    std::set<int, CompareVectors<int>> custom_set(vector_comparator);
+    custom_set.insert(3);
+    custom_set.insert(1);
+
+    // Node 1 should be closer to base_vec than node 3
+    EXPECT_EQ(*(custom_set.begin()), 1);
+    EXPECT_EQ(*(custom_set.rbegin()), 3);
+}
+
+// The batched distances are the same as the distances of calculateDistance, also for the points after the last batch
+TEST(UtilsANN, BatchedDistances){
+    std::vector<std::vector<float>> points;
+    std::vector<const std::vector<float>*> pointers;
+    for(int i = 0; i < 11; i++){
+        points.push_back({(float)i * 0.3f, (float)(i % 4), -1.5f * i, 2.0f, (float)(i * i)});
+    }
+    for(const auto& point : points){
+        pointers.push_back(&point);
+    }
+    std::vector<float> query = {0.1f, 2.0f, 3.0f, -4.0f, 5.5f};
+
+    std::vector<float> distances(points.size());
+    calculateDistances(query, pointers.data(), points.size(), query.size(), distances.data());
+    for(std::size_t i = 0; i < points.size(); i++){
+        EXPECT_EQ(distances[i], calculateDistance(points[i], query, query.size()));
+    }
+
+    // The copies of the comparator in a set read the distances that computeDistances filled
+    CompareVectors<float> compare(points, query);
+    std::set<int, CompareVectors<float>> set(compare);
+    compare.computeDistances({0, 5, 10});
+    set.insert(10);
+    set.insert(5);
+    set.insert(0);
+
+    std::vector<int> expected = {0, 5, 10};
+    std::sort(expected.begin(), expected.end(), [&](int a, int b){ return distances[a] < distances[b]; });
+    EXPECT_EQ(std::vector<int>(set.begin(), set.end()), expected);
+}
+
+TEST(FilteredFindMedoid, LabelIds){
+    std::vector<std::vector<int>> points = {{1, 2}, {3, 4}, {5, 6}, {7, 8}, {9, 10}};
+    std::vector<float> filters = {0.5f, 7.0f, 0.5f, 123456.0f, 7.0f};
+
+    ANN<int> ann(points, filters);
+
+    // Equal filter values share a dense label id
+    EXPECT_EQ(ann.node_to_label[0], ann.node_to_label[2]);
+    EXPECT_EQ(ann.node_to_label[1], ann.node_to_label[4]);
+    EXPECT_NE(ann.node_to_label[0], ann.node_to_label[1]);
+    EXPECT_LT(ann.node_to_label[3], 3u);
+
+    // Start nodes belong to their filter and unknown filters have none
+    EXPECT_EQ(ann.node_to_label[ann.getStartNode(7.0f)], ann.node_to_label[1]);
+    EXPECT_EQ(ann.getStartNode(123456.0f), 3);
+    EXPECT_EQ(ann.getStartNode(2.0f), -1);
+    EXPECT_TRUE(ann.checkFilteredFindMedoid(3));
+}
+
+TEST(FilteredFindMedoid, LoadBalancing){
+    // Node 0 is in the middle of every filter
+    std::vector<std::vector<float>> points = {{5.0f}, {4.0f}, {6.0f}, {3.0f}, {7.0f}, {4.5f}, {5.5f}};
+    std::vector<std::vector<float>> filter_sets = {{1.0f, 2.0f, 3.0f}, {1.0f}, {1.0f}, {2.0f}, {2.0f}, {3.0f}, {3.0f}};
+
+    ANN<float> ann(points, filter_sets);
+    ann.filteredFindMedoid(FIND_MEDOID_THRESHOLD, 1);
+
+    // The first filter takes the node closest to its centroid and the others avoid it
+    EXPECT_EQ(ann.getStartNode(1.0f), 0);
+    EXPECT_NE(ann.getStartNode(2.0f), 0);
+    EXPECT_NE(ann.getStartNode(3.0f), 0);
+    EXPECT_TRUE(ann.checkFilteredFindMedoid(3));
+
+    // The start nodes are the same on every run
+    ANN<float> other(points, filter_sets);
+    other.filteredFindMedoid(FIND_MEDOID_THRESHOLD, 1);
+    for(float filter : {1.0f, 2.0f, 3.0f}){
+        EXPECT_EQ(ann.getStartNode(filter), other.getStartNode(filter));
+    }
+
+    EXPECT_THROW(ann.filteredFindMedoid(0, 1), std::invalid_argument);
+}
+
+TEST(LatencyHistogram, Percentiles){
+    LatencyHistogram latency;
+    EXPECT_EQ(latency.percentile(99), 0u);
+
+    // 1 to 100000 ns, every percentile is within 1/128 of the exact value
+    for(uint64_t value = 1; value <= 100000; value++){
+        latency.record(value);
+    }
+    EXPECT_EQ(latency.count(), 100000u);
+    EXPECT_EQ(latency.max(), 100000u);
+    EXPECT_NEAR(latency.mean(), 50000.5, 1e-6);
+    for(double p : {50.0, 90.0, 99.0, 99.9}){
+        double exact = p / 100 * 100000;
+        EXPECT_NEAR((double)latency.percentile(p), exact, exact / 128) << "Percentile " << p;
+    }
+    EXPECT_EQ(latency.percentile(100), 100000u);
+
+    // Merging keeps the counts of both
+    LatencyHistogram slow;
+    slow.record(1000000000);
+    latency.merge(slow);
+    EXPECT_EQ(latency.count(), 100001u);
+    EXPECT_EQ(latency.percentile(100), 1000000000u);
+    EXPECT_NEAR((double)latency.percentile(50), 50000, 500);
+}
+
+// The report of an index counts every vector and the sampler sees the memory of the process
+TEST(MemoryUsage, ReportAndSampler){
+    RssSampler sampler;
+    sampler.start(10);
+
+    std::vector<std::vector<float>> points(200, std::vector<float>(16, 1.0f));
+    for(std::size_t i = 0; i < points.size(); i++){
+        points[i][0] = (float)i;
+    }
+    ANN<float> ann(points, (size_t)5);
+
+    MemoryReport report = ann.memoryUsage();
+    ASSERT_FALSE(report.parts.empty());
+    EXPECT_EQ(report.parts[0].first, "vectors");
+    EXPECT_GE(report.parts[0].second, 200 * 16 * sizeof(float));
+    EXPECT_GT(report.total(), report.parts[0].second);
+
+    sampler.stop();
+    EXPECT_FALSE(sampler.getSamples().empty());
+    EXPECT_GT(sampler.peakBytes(), 0u);
+    EXPECT_LE(sampler.peakBytes(), peakRss());
+}
+
+// Inner product and cosine distances, also through the batched kernel and a graph built with the metric
+TEST(UtilsANN, Metrics){
+    std::vector<float> v1 = {3.0f, 4.0f};
+    std::vector<float> v2 = {6.0f, 8.0f};
+    std::vector<float> v3 = {-4.0f, 3.0f};
+
+    EXPECT_FLOAT_EQ(metricDistance<L2Metric>(v1, v2, 2), 25.0f);
+    EXPECT_FLOAT_EQ(metricDistance<InnerProductMetric>(v1, v2, 2), -50.0f);
+
+    // Cosine expects normalized vectors
+    normalizeVector(v1);
+    normalizeVector(v2);
+    normalizeVector(v3);
+    EXPECT_NEAR(metricDistance<CosineMetric>(v1, v2, 2), 0.0f, 1e-6);
+    EXPECT_NEAR(metricDistance<CosineMetric>(v1, v3, 2), 1.0f, 1e-6);
+
+    std::vector<std::vector<float>> points;
+    std::vector<const std::vector<float>*> pointers;
+    for(int i = 0; i < 200; i++){
+        points.push_back({(float)(i % 13) + 1.0f, (float)(i % 7) - 3.0f, (float)(i % 5) * 0.5f});
+    }
+    for(const auto& point : points){
+        pointers.push_back(&point);
+    }
+    std::vector<float> query = {2.0f, -1.0f, 0.5f};
+
+    std::vector<float> distances(points.size());
+    calculateDistances<float, InnerProductMetric>(query, pointers.data(), points.size(), query.size(), distances.data());
+    for(std::size_t i = 0; i < points.size(); i++){
+        EXPECT_FLOAT_EQ(distances[i], metricDistance<InnerProductMetric>(points[i], query, query.size()));
+    }
+
+    // The nearest node of a cosine graph has the direction of the query, whatever its length
+    ANN<float, CosineMetric> ann(points, (size_t)6);
+    ann.Vamana(1.2, 40, 6);
+    for(const auto& point : ann.node_to_point_map){
+        EXPECT_NEAR(metricDistance<InnerProductMetric>(point, point, point.size()), -1.0f, 1e-5);
+    }
+
+    std::vector<float> scaled_query = {20.0f, -10.0f, 5.0f};
+    CompareVectors<float, CosineMetric> compare(ann.node_to_point_map, scaled_query);
+    std::set<int, CompareVectors<float, CosineMetric>> NNS(compare);
+    std::unordered_set<int> Visited;
+    ann.greedySearch(0, 5, 40, NNS, Visited, compare);
+
+    normalizeVector(query);
+    float best = std::numeric_limits<float>::max();
+    for(const auto& point : ann.node_to_point_map){
+        best = std::min(best, metricDistance<CosineMetric>(point, query, query.size()));
+    }
+    EXPECT_NEAR(metricDistance<CosineMetric>(ann.node_to_point_map[*NNS.begin()], query, query.size()), best, 1e-5);
+}
+
+// The kernels of the fixed dimensions and of any other dimension agree with a plain sum of the coordinates
+TEST(UtilsANN, FixedDimensions){
+    for(std::size_t dim : {3, 96, 97, 100, 101, 128, 130, 960}){
+        std::vector<std::vector<float>> points;
+        std::vector<const std::vector<float>*> pointers;
+        for(int i = 0; i < 6; i++){
+            std::vector<float> point(dim);
+            for(std::size_t j = 0; j < dim; j++){
+                point[j] = (float)((i * 31 + j * 7) % 23) - 11.5f;
+            }
+            points.push_back(point);
+        }
+        for(const auto& point : points){
+            pointers.push_back(&point);
+        }
+        std::vector<float> query(dim);
+        for(std::size_t j = 0; j < dim; j++){
+            query[j] = (float)(j % 5) * 0.5f;
+        }
+
+        std::vector<float> distances(points.size());
+        calculateDistances(query, pointers.data(), points.size(), dim, distances.data());
+        for(std::size_t i = 0; i < points.size(); i++){
+            double expected = 0.0;
+            for(std::size_t j = 0; j < dim; j++){
+                expected += ((double)points[i][j] - query[j]) * ((double)points[i][j] - query[j]);
+            }
+            EXPECT_NEAR(calculateDistance(points[i], query, dim), expected, expected * 1e-6);
+            EXPECT_EQ(distances[i], calculateDistance(points[i], query, dim));
+        }
+    }
+}
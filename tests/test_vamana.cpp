@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 #include "ann.h"
+#include "profiler.h"
+#include <fstream>
+#include <sstream>
 TEST(ANNTest, TestGetMedoid){
     std::vector<std::vector<int>> points = {{1, 1, 1}, {2, 2, 5}, {2, 4, 5}, {7, 8, 9}};
     ANN<int> ann(points);
@@ -7,6 +10,13 @@ TEST(ANNTest, TestGetMedoid){
     EXPECT_EQ(ann.getMedoid(), expected_medoid);
 }
 
+// The inner product would choose the largest point, {7, 8, 9}, so the medoid is the one of L2
+TEST(ANNTest, InnerProductMedoid){
+    std::vector<std::vector<int>> points = {{1, 1, 1}, {2, 2, 5}, {2, 4, 5}, {7, 8, 9}};
+    ANN<int, InnerProductMetric> ann(points);
+    EXPECT_EQ(ann.getMedoid(), 2);
+}
+
 // Degree Bound Check
 TEST(VamanaIndexingTest, DegreeBound1) {
     std::vector<std::vector<int>> points = {{1, 1, 1}, {2, 2, 2}, {3, 3, 3}, {4, 4, 4}};
@@ -142,4 +152,456 @@ TEST(StitchedVamana, BasicFunct){
     delete ann;
 
 
-}
\ No newline at end of file
+}
+
+TEST(NNDescent, ExactOnSmallDataset){
+    // Points on a line with different gaps, so that there are no ties
+    std::vector<std::vector<float>> points;
+    float position = 0.0;
+    for(int i = 0; i < 20; i++){
+        points.push_back({position});
+        position += 1.0 + 0.1 * (i % 7);
+    }
+
+    ANN<float> ann(points, std::vector<std::unordered_set<int>>{});
+    int K = 3;
+    ann.nnDescent(K);
+
+    for(size_t i = 0; i < points.size(); i++){
+        // Find the K nearest neighbours by brute force
+        std::vector<std::pair<float, int>> distances;
+        for(size_t j = 0; j < points.size(); j++){
+            if(i != j)
+                distances.push_back({calculateDistance(points[i], points[j], 1), (int)j});
+        }
+        std::sort(distances.begin(), distances.end());
+
+        EXPECT_EQ(ann.countNeighbours(i), K);
+        for(int j = 0; j < K; j++){
+            EXPECT_TRUE(ann.checkNeighbour(i, distances[j].second)) << "Node " << i << " misses neighbour " << distances[j].second;
+        }
+    }
+}
+
+TEST(NNDescent, VamanaInitialization){
+    std::vector<std::vector<float>> points = {
+        {0.0, 0.0}, {1.0, 1.0}, {2.0, 2.0}, {3.0, 3.0}, {4.0, 4.0}, {5.0, 5.6}, {10.0, 11.0}
+    };
+
+    int L = 3;
+    int R = 2;
+    float alpha = 1.1;
+
+    ANN<float> ann(points, (size_t)R);
+    ann.Vamana(alpha, L, R, true);
+
+    for(size_t i = 0; i < points.size(); i++){
+        EXPECT_LE(ann.countNeighbours(i), R) << "Degree bound exceeded for node " << i;
+    }
+
+    // Filtered Vamana must keep edges inside the filters
+    std::vector<float> filters = {1.2, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0};
+    ANN<float> filtered_ann(points, filters);
+    filtered_ann.filteredVamana(alpha, L, R, 0, true);
+
+    for(size_t i = 0; i < points.size(); i++){
+        EXPECT_LE(filtered_ann.countNeighbours(i), R) << "Degree bound exceeded for node " << i;
+    }
+    EXPECT_TRUE(filtered_ann.checkFilters());
+}
+
+TEST(MultiPassVamana, DegreeBound){
+    std::vector<std::vector<float>> points = {
+        {0.0, 0.0}, {1.0, 1.0}, {2.0, 2.0}, {3.0, 3.0}, {4.0, 4.0}, {5.0, 5.6}, {10.0, 11.0}
+    };
+    std::vector<float> filters = {1.2, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0};
+
+    // First pass with alpha = 1 and second with alpha > 1
+    std::vector<VamanaPass> passes = {{1.0, 3}, {1.2, 4}};
+    int R = 2;
+
+    ANN<float> ann(points, (size_t)R);
+    ann.Vamana(passes, R);
+
+    ANN<float> filtered_ann(points, filters);
+    filtered_ann.filteredVamana(passes, R);
+
+    ANN<float> stitched_ann(points, filters);
+    stitched_ann.stitchedVamana(passes, R, 2 * R);
+
+    for(size_t i = 0; i < points.size(); i++){
+        EXPECT_LE(ann.countNeighbours(i), R) << "Degree bound exceeded for node " << i;
+        EXPECT_LE(filtered_ann.countNeighbours(i), R) << "Degree bound exceeded for node " << i;
+        EXPECT_LE(stitched_ann.countNeighbours(i), 2 * R) << "Degree bound exceeded for node " << i;
+    }
+    EXPECT_TRUE(filtered_ann.checkFilters());
+    EXPECT_TRUE(stitched_ann.checkFilters());
+
+    // At least one pass is needed
+    EXPECT_THROW(ann.Vamana(std::vector<VamanaPass>{}, R), std::invalid_argument);
+}
+
+TEST(StitchedVamana, BuildsEveryFilter){
+    // Two filters with points mixed in the dataset
+    std::vector<std::vector<float>> points;
+    std::vector<float> filters;
+    for(int i = 0; i < 40; i++){
+        points.push_back({(float)i, (float)(i % 5)});
+        filters.push_back(i % 2 == 0 ? 1.0f : 2.0f);
+    }
+
+    int R_small = 4;
+    int R_stitched = 6;
+    ANN<float> ann(points, filters);
+    ann.stitchedVamana(1.2, 10, R_small, R_stitched);
+
+    for(size_t i = 0; i < points.size(); i++){
+        EXPECT_GT(ann.countNeighbours(i), 0) << "Node " << i << " has no neighbours";
+        EXPECT_LE(ann.countNeighbours(i), R_stitched) << "Degree bound exceeded for node " << i;
+    }
+    EXPECT_TRUE(ann.checkFilters());
+}
+
+TEST(StitchedVamana, StitchKeepsClosestNeighbour){
+    // Points of the filter are placed so that the closest point doesn't have the smallest index
+    std::vector<std::vector<float>> points = {{0.0}, {10.0}, {3.0}, {7.0}, {1.0}, {100.0}};
+    std::vector<float> filters = {1.0, 1.0, 1.0, 1.0, 1.0, 2.0};
+    std::vector<int> closest = {4, 3, 4, 1, 0};
+
+    // With R = 1 stitching must keep only the closest neighbour
+    ANN<float> ann(points, filters);
+    ann.stitchedVamana(1.0, 5, 4, 1);
+
+    for(size_t i = 0; i < closest.size(); i++){
+        EXPECT_EQ(ann.countNeighbours(i), 1);
+        EXPECT_TRUE(ann.checkNeighbour(i, closest[i])) << "Node " << i << " should keep neighbour " << closest[i];
+    }
+}
+
+TEST(FilteredVamana, SharedLabels){
+    // Every point has label i % 3 and the multiples of 5 have label 10 too
+    std::vector<std::vector<float>> points;
+    std::vector<std::vector<float>> filter_sets;
+    for(int i = 0; i < 90; i++){
+        points.push_back({(float)i, (float)(i % 7)});
+        filter_sets.push_back({(float)(i % 3)});
+        if(i % 5 == 0)
+            filter_sets.back().push_back(10.0f);
+    }
+
+    int R = 6;
+    ANN<float> filtered(points, filter_sets);
+    filtered.filteredVamana(1.2, 20, R);
+
+    ANN<float> stitched(points, filter_sets);
+    stitched.stitchedVamana(1.2, 20, 4, R);
+
+    for(size_t i = 0; i < points.size(); i++){
+        EXPECT_GT(filtered.countNeighbours(i), 0) << "Node " << i << " has no neighbours";
+        EXPECT_LE(filtered.countNeighbours(i), R) << "Degree bound exceeded for node " << i;
+        EXPECT_LE(stitched.countNeighbours(i), R) << "Degree bound exceeded for node " << i;
+    }
+    EXPECT_TRUE(filtered.checkFilters());
+    EXPECT_TRUE(stitched.checkFilters());
+}
+
+TEST(BridgeEdges, ConnectLabels){
+    // Two filters in two groups far from each other
+    std::vector<std::vector<float>> points;
+    std::vector<float> filters;
+    for(int i = 0; i < 60; i++){
+        bool second = i % 2 == 1;
+        points.push_back({(float)(i + (second ? 1000 : 0)), (float)(i % 7)});
+        filters.push_back(second ? 2.0f : 1.0f);
+    }
+
+    int R = 4;
+    int B = 2;
+    ANN<float> ann(points, filters);
+    ann.filteredVamana(1.2, 10, R);
+    EXPECT_TRUE(ann.checkFilters());
+
+    ann.addBridgeEdges(B, 1.2, 10);
+    EXPECT_FALSE(ann.checkFilters());
+
+    for(size_t i = 0; i < points.size(); i++){
+        std::vector<int> neighbours;
+        ann.neighbourNodes(i, neighbours);
+        int bridges = (int)std::count_if(neighbours.begin(), neighbours.end(), [&](int j){ return filters[j] != filters[i]; });
+        EXPECT_LE(bridges, B) << "Too many bridge edges for node " << i;
+        EXPECT_LE(ann.countNeighbours(i), R + B) << "Degree bound exceeded for node " << i;
+    }
+
+    // An unfiltered search from the medoid reaches both filters
+    for(float target : {0.0f, 1050.0f}){
+        std::vector<float> query = {target, 0.0f};
+        CompareVectors<float> compare(ann.node_to_point_map, query);
+        std::set<int, CompareVectors<float>> NNS(compare);
+        std::unordered_set<int> Visited;
+        NNS.insert(ann.getMedoid());
+        ann.greedySearch(ann.getMedoid(), 1, 10, NNS, Visited, compare);
+        ASSERT_EQ(NNS.size(), 1u);
+        EXPECT_EQ(filters[*NNS.begin()], target == 0.0f ? 1.0f : 2.0f);
+    }
+
+    // Filtered searches still skip the bridge edges
+    std::vector<float> query = {1050.0f, 0.0f};
+    CompareVectors<float> compare(ann.node_to_point_map, query);
+    std::set<int, CompareVectors<float>> NNS(compare);
+    std::unordered_set<int> Visited;
+    int start_node = ann.getStartNode(1.0f);
+    NNS.insert(start_node);
+    ann.filteredGreedySearch(start_node, 3, 10, 1.0f, NNS, Visited, compare);
+    for(int node : NNS){
+        EXPECT_EQ(filters[node], 1.0f);
+    }
+}
+
+TEST(FilteredVamana, BatchedLargeFilter){
+    // The first filter is large enough to be inserted in parallel batches
+    std::vector<std::vector<float>> points;
+    std::vector<float> filters;
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> dis(0.0f, 1000.0f);
+    for(int i = 0; i < BATCH_LABEL_SIZE + 200; i++){
+        points.push_back({dis(gen), dis(gen)});
+        filters.push_back(i < BATCH_LABEL_SIZE ? 1.0f : 2.0f);
+    }
+
+    int R = 8;
+    ANN<float> ann(points, filters);
+    ann.filteredVamana(1.2, 20, R);
+
+    for(size_t i = 0; i < points.size(); i++){
+        EXPECT_LE(ann.countNeighbours(i), R) << "Degree bound exceeded for node " << i;
+    }
+    EXPECT_TRUE(ann.checkFilters());
+
+    // Points of the large filter are found by a filtered search
+    int found = 0;
+    for(int i = 0; i < 100; i++){
+        CompareVectors<float> compare(ann.node_to_point_map, points[i]);
+        std::set<int, CompareVectors<float>> NNS(compare);
+        std::unordered_set<int> Visited;
+        int start_node = ann.getStartNode(1.0f);
+        NNS.insert(start_node);
+        ann.filteredGreedySearch(start_node, 1, 20, 1.0f, NNS, Visited, compare);
+        found += *NNS.begin() == i;
+    }
+    EXPECT_GE(found, 95);
+}
+
+TEST(RuntimeConfig, EveryStrategy){
+    std::vector<std::vector<float>> points;
+    std::vector<float> filters;
+    for(int i = 0; i < 120; i++){
+        points.push_back({(float)(i % 11), (float)(i % 13)});
+        filters.push_back((float)(i % 4));
+    }
+
+    int R = 6;
+    for(ParallelStrategy parallel : {ParallelStrategy::Serial, ParallelStrategy::Build, ParallelStrategy::Full}){
+        for(MedoidStrategy medoid : {MedoidStrategy::Random, MedoidStrategy::Exact}){
+            RuntimeConfig config;
+            config.threads = 2;
+            config.parallel = parallel;
+            config.medoid = medoid;
+            config.precompute_build = parallel != ParallelStrategy::Serial;
+
+            ANN<float> unfiltered(points, (size_t)R);
+            unfiltered.config = config;
+            unfiltered.Vamana(1.2, 20, R);
+
+            ANN<float> stitched(points, filters);
+            stitched.config = config;
+            stitched.stitchedVamana(1.2, 20, 4, R);
+
+            for(size_t i = 0; i < points.size(); i++){
+                EXPECT_LE(unfiltered.countNeighbours(i), R) << "Degree bound exceeded for node " << i;
+                EXPECT_LE(stitched.countNeighbours(i), R) << "Degree bound exceeded for node " << i;
+            }
+            EXPECT_TRUE(stitched.checkFilters());
+        }
+    }
+}
+
+TEST(Profiler, PhasesAndTrace){
+    std::vector<std::vector<float>> points;
+    for(int i = 0; i < 100; i++){
+        points.push_back({(float)(i % 10), (float)(i / 10)});
+    }
+
+    Profiler::start(false);
+    ANN<float> ann(points, (size_t)5);
+    ann.Vamana(std::vector<VamanaPass>{{1.0, 20}, {1.2, 20}}, 5);
+
+    // Every pass inserts every point once
+    EXPECT_EQ(Profiler::phaseTotals(ProfilePhase::Greedy).calls, 2 * points.size());
+    EXPECT_EQ(Profiler::phaseTotals(ProfilePhase::Prune).calls, 2 * points.size());
+    EXPECT_EQ(Profiler::phaseTotals(ProfilePhase::Reverse).calls, 2 * points.size());
+
+    std::string file_path = "./build/test_profile.json";
+    Profiler::save(file_path);
+    Profiler::stop();
+    EXPECT_EQ(Profiler::phaseTotals(ProfilePhase::Greedy).calls, 0u);
+
+    std::ifstream file(file_path);
+    std::stringstream trace;
+    trace << file.rdbuf();
+    EXPECT_NE(trace.str().find("\"traceEvents\""), std::string::npos);
+    EXPECT_NE(trace.str().find("\"name\":\"Vamana pass\""), std::string::npos);
+    EXPECT_NE(trace.str().find("\"greedy_calls\":100"), std::string::npos);
+    std::remove(file_path.c_str());
+}
+
+TEST(ANNTest, MovedPoints){
+    std::vector<std::vector<float>> points;
+    std::vector<float> filters;
+    std::vector<float> timestamps;
+    for(int i = 0; i < 50; i++){
+        points.push_back({(float)i, (float)(i % 7)});
+        filters.push_back((float)(i % 3));
+        timestamps.push_back((float)i / 50);
+    }
+    std::vector<std::vector<float>> expected = points;
+
+    // The copy and the moved points give the same index and the moved vectors are taken without a copy
+    ANN<float> copied(points, filters, timestamps);
+    const float* data = points[0].data();
+    ANN<float> moved(std::move(points), filters, timestamps);
+
+    EXPECT_EQ(moved.node_to_point_map, expected);
+    EXPECT_EQ(copied.node_to_point_map, expected);
+    EXPECT_EQ(moved.node_to_point_map[0].data(), data);
+    EXPECT_EQ(moved.node_to_label, copied.node_to_label);
+    EXPECT_EQ(moved.node_to_timestamp, copied.node_to_timestamp);
+
+    std::vector<std::vector<float>> wrong(10, std::vector<float>(2, 0.0f));
+    EXPECT_THROW(ANN<float>(std::move(wrong), filters, timestamps), std::invalid_argument);
+}
+
+TEST(ANNTest, Reorder){
+    std::vector<std::vector<float>> points;
+    std::vector<float> filters;
+    std::vector<float> timestamps;
+    for(int i = 0; i < 200; i++){
+        points.push_back({(float)(i % 13), (float)(i % 7), (float)i / 20});
+        filters.push_back((float)(i % 4));
+        timestamps.push_back((float)((i * 37) % 200));
+    }
+    std::size_t n = points.size();
+
+    for(ReorderStrategy strategy : {ReorderStrategy::BFS, ReorderStrategy::RCM, ReorderStrategy::Gorder}){
+        ANN<float> ann(points, filters, timestamps);
+        ann.filteredVamana(1.2, 20, 6);
+        ann.filteredFindMedoid();
+        int start = ann.getStartNode(1.0);
+
+        std::vector<std::vector<int>> edges(n);
+        for(std::size_t i = 0; i < n; i++){
+            ann.neighbourNodes(i, edges[i]);
+            std::sort(edges[i].begin(), edges[i].end());
+        }
+
+        ann.reorder(strategy);
+        ASSERT_EQ(ann.node_to_original.size(), n);
+        std::vector<int> sorted = ann.node_to_original;
+        std::sort(sorted.begin(), sorted.end());
+        for(std::size_t i = 0; i < n; i++){
+            ASSERT_EQ(sorted[i], (int)i);
+        }
+
+        // Every node keeps its vector, timestamp and edges under the new ids
+        for(std::size_t i = 0; i < n; i++){
+            int original = ann.node_to_original[i];
+            EXPECT_EQ(ann.node_to_point_map[i], points[original]);
+            EXPECT_EQ(ann.node_to_timestamp[i], timestamps[original]);
+
+            std::vector<int> neighbours;
+            ann.neighbourNodes(i, neighbours);
+            for(int& neighbour : neighbours){
+                neighbour = ann.node_to_original[neighbour];
+            }
+            std::sort(neighbours.begin(), neighbours.end());
+            EXPECT_EQ(neighbours, edges[original]);
+        }
+        EXPECT_TRUE(ann.checkFilters());
+        EXPECT_EQ(ann.node_to_original[ann.getStartNode(1.0)], start);
+
+        // A loaded graph puts the points of the input in the saved order
+        std::string file_path = "./build/test_reorder.graph";
+        std::remove(file_path.c_str());
+        ann.saveGraph(file_path);
+        ANN<float> loaded(points, filters, timestamps);
+        loaded.loadGraph(file_path);
+        std::remove(file_path.c_str());
+
+        EXPECT_EQ(loaded.node_to_original, ann.node_to_original);
+        EXPECT_EQ(loaded.node_to_point_map, ann.node_to_point_map);
+        EXPECT_EQ(loaded.node_to_label, ann.node_to_label);
+        EXPECT_TRUE(loaded.checkFilters());
+    }
+}
+
+// The BFS order of a filtered index starts from the start node of every label, without the medoid of all the points
+TEST(ANNTest, ReorderFilteredBFS){
+    std::vector<std::vector<float>> points;
+    std::vector<float> filters;
+    for(int i = 0; i < 300; i++){
+        points.push_back({(float)(i % 17), (float)(i % 11), (float)i / 30});
+        filters.push_back((float)(i % 3));
+    }
+
+    ANN<float> ann(points, filters);
+    ann.filteredVamana(1.2, 20, 6);
+    std::vector<int> starts = {ann.getStartNode(0.0f), ann.getStartNode(1.0f), ann.getStartNode(2.0f)};
+
+    // Nodes that the search from the first start reaches
+    std::vector<bool> reached(points.size(), false);
+    std::vector<int> queue = {starts[0]};
+    reached[starts[0]] = true;
+    for(std::size_t head = 0; head < queue.size(); head++){
+        std::vector<int> neighbours;
+        ann.neighbourNodes(queue[head], neighbours);
+        for(int neighbour : neighbours){
+            if(!reached[neighbour]){
+                reached[neighbour] = true;
+                queue.push_back(neighbour);
+            }
+        }
+    }
+
+    ann.reorder(ReorderStrategy::BFS);
+    EXPECT_EQ(ann.getStartNode(0.0f), 0);
+    std::vector<int> first(ann.node_to_original.begin(), ann.node_to_original.begin() + queue.size());
+    std::sort(first.begin(), first.end());
+    std::sort(queue.begin(), queue.end());
+    EXPECT_EQ(first, queue);
+
+    // The next root is the start of the second label, unless the first search reached it
+    if(!reached[starts[1]]){
+        EXPECT_EQ(ann.getStartNode(1.0f), (int)queue.size());
+    }
+    EXPECT_TRUE(ann.checkFilters());
+}
+
+// A saved graph keeps the random start node of its build, so a loaded graph is searched from the same node
+TEST(ANNTest, SaveMedoid){
+    std::vector<std::vector<float>> points;
+    for(int i = 0; i < 200; i++){
+        points.push_back({(float)(i % 13), (float)(i % 7), (float)i / 20});
+    }
+
+    ANN<float> ann(points, (size_t)6);
+    ann.Vamana(1.2, 20, 6);
+    int medoid = ann.startMedoid();
+
+    std::string file_path = "./build/test_medoid.graph";
+    std::remove(file_path.c_str());
+    ann.saveGraph(file_path);
+    ANN<float> loaded(points, (size_t)6);
+    loaded.loadGraph(file_path);
+    std::remove(file_path.c_str());
+
+    EXPECT_EQ(loaded.startMedoid(), medoid);
+}
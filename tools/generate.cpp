@@ -0,0 +1,287 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <map>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include "defs.h"
+#include "utils_main.h"
+
+// Generator of synthetic datasets for benchmarks on machines without the downloaded datasets.
+// Points are drawn from Gaussian clusters, labels follow a Zipf distribution and timestamps are uniform in [0, 1).
+
+#define BIN_DIMENSION 100                       // parseDataVector and parseQueryVector read 100 floats per point
+
+struct GeneratorOptions{
+    std::string prefix;
+    std::string format = "bin";
+    std::size_t n = 100000;
+    std::size_t dim = BIN_DIMENSION;
+    std::size_t queries = 1000;
+    std::size_t clusters = 64;
+    float spread = 5.0f;                        // Standard deviation of every cluster, the centers are in [0, 100)
+    std::size_t labels = 10;
+    double zipf = 1.0;                          // Label l has probability proportional to 1 / (l + 1)^zipf
+    bool ground_truth = true;
+    unsigned seed = 0;
+};
+
+void printHelp(){
+    std::cout << GREEN << "Usage: " << RESET << CYAN << "./generate " << RESET
+              << YELLOW << "-o " << MAGENTA << "<prefix> " << RESET
+              << "[" << YELLOW << "-f " << MAGENTA << "<bin/fvecs/bvecs>" << RESET << "] "
+              << "[" << YELLOW << "-n " << MAGENTA << "<points>" << RESET << "] "
+              << "[" << YELLOW << "-d " << MAGENTA << "<dimension>" << RESET << "] "
+              << "[" << YELLOW << "-q " << MAGENTA << "<queries>" << RESET << "] "
+              << "[" << YELLOW << "-clusters " << MAGENTA << "<C>" << RESET << "] "
+              << "[" << YELLOW << "-spread " << MAGENTA << "<sigma>" << RESET << "] "
+              << "[" << YELLOW << "-labels " << MAGENTA << "<labels>" << RESET << "] "
+              << "[" << YELLOW << "-zipf " << MAGENTA << "<s>" << RESET << "] "
+              << "[" << YELLOW << "-gt " << MAGENTA << "<y/n>" << RESET << "] "
+              << "[" << YELLOW << "-seed " << MAGENTA << "<seed>" << RESET << "]" << std::endl << std::endl;
+
+    std::cout << GREEN << "Options:" << RESET << std::endl;
+    std::cout << "  -o <prefix> : Prefix of the files. bin writes <prefix>_data.bin, <prefix>_queries.bin and <prefix>_groundtruth.bin, "
+              << "fvecs and bvecs write <prefix>_base, <prefix>_query and <prefix>_groundtruth.ivecs." << std::endl;
+    std::cout << "  -f <bin/fvecs/bvecs> : (Optional) Format of the files. Default is bin, which is always 100 dimensional and has labels, timestamps and all four query types." << std::endl;
+    std::cout << "  -n <points> : (Optional) Base points. Default is 100000." << std::endl;
+    std::cout << "  -d <dimension> : (Optional) Dimension of fvecs and bvecs. Default is 100." << std::endl;
+    std::cout << "  -q <queries> : (Optional) Queries. Default is 1000." << std::endl;
+    std::cout << "  -clusters <C> : (Optional) Gaussian clusters. Default is 64." << std::endl;
+    std::cout << "  -spread <sigma> : (Optional) Standard deviation of every cluster, the centers are in [0, 100). Default is 5." << std::endl;
+    std::cout << "  -labels <labels> : (Optional) Filter values of bin. Default is 10." << std::endl;
+    std::cout << "  -zipf <s> : (Optional) Exponent of the Zipf distribution of the labels, 0 for uniform. Default is 1." << std::endl;
+    std::cout << "  -gt <y/n> : (Optional) Calculate the ground truth with brute force on all the threads. Default is y." << std::endl;
+    std::cout << "  -seed <seed> : (Optional) Seed of the generator. Default is 0." << std::endl << std::endl;
+    std::cout << GREEN << "Example:" << RESET << std::endl;
+    std::cout << CYAN << "  ./bin/generate -o ./data/synthetic -n 1000000 -q 1000 -labels 100 -zipf 1.1" << RESET << std::endl;
+}
+
+GeneratorOptions parseOptions(int argc, char** argv){
+    if((argc - 1) % 2 != 0){
+        throw std::invalid_argument("Invalid number of arguments. Flags must have values.");
+    }
+
+    std::map<std::string, std::string> args;
+    for(int i = 1; i < argc; i += 2){
+        args[argv[i]] = argv[i + 1];
+    }
+
+    GeneratorOptions options;
+    for(const auto& [flag, value] : args){
+        if(flag == "-o") options.prefix = value;
+        else if(flag == "-f") options.format = value;
+        else if(flag == "-n") options.n = std::stoul(value);
+        else if(flag == "-d") options.dim = std::stoul(value);
+        else if(flag == "-q") options.queries = std::stoul(value);
+        else if(flag == "-clusters") options.clusters = std::stoul(value);
+        else if(flag == "-spread") options.spread = std::stof(value);
+        else if(flag == "-labels") options.labels = std::stoul(value);
+        else if(flag == "-zipf") options.zipf = std::stod(value);
+        else if(flag == "-gt") options.ground_truth = value == "y";
+        else if(flag == "-seed") options.seed = std::stoul(value);
+        else throw std::invalid_argument("Invalid flag: " + flag);
+    }
+
+    if(options.prefix.empty()){
+        throw std::invalid_argument("Missing required flag: -o");
+    }
+    if(options.format != "bin" && options.format != "fvecs" && options.format != "bvecs"){
+        throw std::invalid_argument("Invalid format " + options.format);
+    }
+    if(options.format == "bin" && options.dim != BIN_DIMENSION){
+        throw std::invalid_argument("bin files have 100 dimensions");
+    }
+    if(options.n == 0 || options.dim == 0 || options.clusters == 0 || options.labels == 0){
+        throw std::invalid_argument("Points, dimension, clusters and labels must be positive");
+    }
+
+    return options;
+}
+
+// Draws points from the same clusters for the base and the queries
+template <typename datatype>
+class ClusterSampler{
+private:
+    std::vector<std::vector<float>> centers;
+    float spread;
+    float high;
+public:
+    ClusterSampler(std::size_t clusters, std::size_t dim, float spread, float high, std::mt19937& gen) : spread(spread), high(high){
+        std::uniform_real_distribution<float> uniform(0.0f, high);
+        this->centers.assign(clusters, std::vector<float>(dim));
+        for(auto& center : this->centers){
+            for(auto& coordinate : center){
+                coordinate = uniform(gen);
+            }
+        }
+    }
+
+    std::vector<datatype> sample(std::mt19937& gen){
+        std::uniform_int_distribution<std::size_t> cluster(0, this->centers.size() - 1);
+        std::normal_distribution<float> noise(0.0f, this->spread);
+
+        const std::vector<float>& center = this->centers[cluster(gen)];
+        std::vector<datatype> point(center.size());
+        for(std::size_t i = 0; i < center.size(); i++){
+            float coordinate = center[i] + noise(gen);
+            if constexpr (std::is_same_v<datatype, unsigned char>)
+                coordinate = std::round(std::min(std::max(coordinate, 0.0f), 255.0f));
+            point[i] = (datatype)coordinate;
+        }
+        return point;
+    }
+};
+
+template <typename datatype>
+void writeVecs(const std::string& path, const std::vector<std::vector<datatype>>& points){
+    std::ofstream file(path, std::ios::binary);
+    if(!file){
+        throw std::runtime_error("Could not open file " + path);
+    }
+
+    for(const auto& point : points){
+        int dim = (int)point.size();
+        file.write((char*)&dim, sizeof(int));
+        file.write((char*)point.data(), dim * sizeof(datatype));
+    }
+}
+
+template <typename datatype>
+void generateVecs(const GeneratorOptions& options, float high){
+    std::mt19937 gen(options.seed);
+    ClusterSampler<datatype> sampler(options.clusters, options.dim, options.spread, high, gen);
+
+    std::vector<std::vector<datatype>> base(options.n);
+    for(auto& point : base){
+        point = sampler.sample(gen);
+    }
+    std::vector<std::vector<datatype>> queries(options.queries);
+    for(auto& query : queries){
+        query = sampler.sample(gen);
+    }
+
+    writeVecs(options.prefix + "_base." + options.format, base);
+    writeVecs(options.prefix + "_query." + options.format, queries);
+    std::cout << GREEN << "Wrote " << options.n << " points and " << options.queries << " queries" << RESET << std::endl;
+
+    if(options.ground_truth){
+        std::cout << BLUE << "Calculating ground truth. This may take a while..." << RESET << std::endl;
+        std::vector<std::vector<std::pair<float, int>>> gt;
+        calculateGroundTruth(queries, base, gt);
+        saveGroundTruth(options.prefix + "_groundtruth.ivecs", gt);
+    }
+}
+
+void generateBin(const GeneratorOptions& options){
+    std::mt19937 gen(options.seed);
+    ClusterSampler<float> sampler(options.clusters, BIN_DIMENSION, options.spread, 100.0f, gen);
+
+    std::vector<double> weights(options.labels);
+    for(std::size_t l = 0; l < options.labels; l++){
+        weights[l] = 1.0 / std::pow((double)(l + 1), options.zipf);
+    }
+    std::discrete_distribution<std::size_t> label(weights.begin(), weights.end());
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    std::vector<std::vector<float>> base(options.n);
+    std::vector<float> filters(options.n);
+    std::vector<float> timestamps(options.n);
+    for(std::size_t i = 0; i < options.n; i++){
+        base[i] = sampler.sample(gen);
+        filters[i] = (float)label(gen);
+        timestamps[i] = uniform(gen);
+    }
+
+    // Queries of every type in turn: vector only, filter, timestamp range and filter with timestamp range.
+    // The filters of the queries follow the labels of the points and the ranges cover 5% to 50% of the timestamps.
+    std::vector<std::vector<float>> queries(options.queries);
+    std::vector<float> query_types(options.queries);
+    std::vector<float> query_filters(options.queries);
+    std::vector<std::pair<float, float>> query_ranges(options.queries);
+    std::uniform_real_distribution<float> width(0.05f, 0.5f);
+    for(std::size_t i = 0; i < options.queries; i++){
+        int type = (int)(i % 4);
+        queries[i] = sampler.sample(gen);
+        query_types[i] = (float)type;
+        query_filters[i] = (type == 1 || type == 3) ? (float)label(gen) : -1.0f;
+
+        float range = width(gen);
+        float low = uniform(gen) * (1.0f - range);
+        query_ranges[i] = (type >= 2) ? std::make_pair(low, low + range) : std::make_pair(-1.0f, -1.0f);
+    }
+
+    std::string data_path = options.prefix + "_data.bin";
+    std::ofstream data(data_path, std::ios::binary);
+    if(!data){
+        throw std::runtime_error("Could not open file " + data_path);
+    }
+    uint32_t n = (uint32_t)options.n;
+    data.write((char*)&n, sizeof(uint32_t));
+    for(std::size_t i = 0; i < options.n; i++){
+        data.write((char*)&filters[i], sizeof(float));
+        data.write((char*)&timestamps[i], sizeof(float));
+        data.write((char*)base[i].data(), BIN_DIMENSION * sizeof(float));
+    }
+    data.close();
+
+    std::string queries_path = options.prefix + "_queries.bin";
+    std::ofstream query_file(queries_path, std::ios::binary);
+    if(!query_file){
+        throw std::runtime_error("Could not open file " + queries_path);
+    }
+    uint32_t q = (uint32_t)options.queries;
+    query_file.write((char*)&q, sizeof(uint32_t));
+    for(std::size_t i = 0; i < options.queries; i++){
+        query_file.write((char*)&query_types[i], sizeof(float));
+        query_file.write((char*)&query_filters[i], sizeof(float));
+        query_file.write((char*)&query_ranges[i].first, sizeof(float));
+        query_file.write((char*)&query_ranges[i].second, sizeof(float));
+        query_file.write((char*)queries[i].data(), BIN_DIMENSION * sizeof(float));
+    }
+    query_file.close();
+    std::cout << GREEN << "Wrote " << options.n << " points and " << options.queries << " queries" << RESET << std::endl;
+
+    if(options.ground_truth){
+        // Same rules as processBinFormat, queries without a range accept every timestamp
+        for(std::size_t i = 0; i < options.queries; i++){
+            if(query_types[i] < 2)
+                query_ranges[i] = std::make_pair(-std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity());
+        }
+
+        std::cout << BLUE << "Calculating ground truth. This may take a while..." << RESET << std::endl;
+        std::vector<std::vector<std::pair<float, int>>> gt;
+        calculateGroundTruth(queries, base, gt, &query_filters, &filters, &query_ranges, &timestamps);
+        saveGroundTruth(options.prefix + "_groundtruth.bin", gt);
+    }
+}
+
+int main(int argc, char** argv){
+    try{
+        if(argc == 2 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")){
+            printHelp();
+            return 0;
+        }
+
+        GeneratorOptions options = parseOptions(argc, argv);
+        if(options.format == "bin")
+            generateBin(options);
+        else if(options.format == "fvecs")
+            generateVecs<float>(options, 100.0f);
+        else
+            generateVecs<unsigned char>(options, 255.0f);
+
+        std::cout << GREEN << "Dataset generated successfully" << RESET << std::endl;
+    }
+    catch(const std::exception& e){
+        std::cerr << RED << "Error : " << e.what() << RESET << std::endl;
+        return 1;
+    }
+
+    return 0;
+}